@@ -0,0 +1,26 @@
+#include <iostream>
+
+#include "bf.hpp"
+
+int main() try
+{
+    bf::interpreter interp;
+    interp.instrument().enable();
+
+    interp
+      .parse("++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]")
+      .parse(">>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.")
+      .run();
+
+    interp.out().flush();
+    std::cerr << '\n';
+    if (!interp.good())
+    {
+        BOOST_THROW_EXCEPTION(bf::bf_error(interp.error().message()));
+    }
+    interp.instrument().report(std::cerr);
+}
+catch (bf::bf_error &e)
+{
+    std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,501 @@
+// Brainfuck Interpreter - bf.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_bf_hpp_
+#define esolang_bf_hpp_
+
+#include <istream>
+#include <ostream>
+#include <iostream>
+
+#include <string>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <boost/throw_exception.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../ecci.hpp"
+
+namespace bf {
+
+struct bf_error : public ecci::ecci_error
+{
+    explicit
+    bf_error(const std::string &x)
+      : ecci::ecci_error("brainfuck", x)
+    {}
+};
+
+// Compiled instruction.  Cell operands are relative to the data pointer by
+// offset, which never exceeds max_offset in magnitude.
+struct insn
+{
+    enum op_t
+    {
+      ADD = 0,  // cell += arg
+      MOVE,     // pointer += arg
+      OUT,      // put cell
+      IN,       // get cell, unchanged on EOF
+      OPEN,     // if !cell[0] jump past arg
+      CLOSE,    // if cell[0] jump past arg
+      CLEAR,    // cell = 0
+      MULADD,   // cell += cell[0] * arg
+      SCAN,     // pointer += arg until !cell[0]
+
+      _SIZE
+    };
+
+    op_t         op;
+    std::int32_t arg, offset;
+};
+
+static constexpr std::int32_t max_offset = 256;
+
+namespace detail {
+
+// First zero in [i, n), or n.
+inline std::size_t
+find_zero(const unsigned char *t, std::size_t i, std::size_t n) noexcept
+{
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + i));
+        if (const int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)))
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+#endif
+    for (; i != n; ++i)
+    {
+        if (!t[i]) { return i; }
+    }
+    return n;
+}
+
+// Last zero in [lo, i], or lo - 1.
+inline std::ptrdiff_t
+rfind_zero(const unsigned char *t, std::ptrdiff_t i, std::ptrdiff_t lo) noexcept
+{
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i - 15 >= lo; i -= 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + i - 15));
+        if (const int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)))
+        {
+            return i - 15 + (31 - __builtin_clz(m));
+        }
+    }
+#endif
+    for (; i >= lo; --i)
+    {
+        if (!t[i]) { return i; }
+    }
+    return lo - 1;
+}
+
+} // namespace bf::detail
+
+// Optimizing interpreter.  Straight-line code is folded into offset
+// additions and one pointer move; clear, move/multiply and scan loops
+// become single instructions.
+struct interpreter : public ecci::ecci_base
+{
+    interpreter &
+    operator=(const interpreter &) = delete;
+    interpreter &
+    operator=(interpreter &&) = delete;
+
+    interpreter()
+      : interpreter(std::cin, std::cout)
+    { }
+
+    explicit
+    interpreter(std::istream &in, std::ostream &out)
+      : ecci::ecci_base(in, out)
+    { }
+
+    explicit
+    interpreter(std::iostream &inout)
+      : interpreter(inout, inout)
+    { }
+
+    using ecci::ecci_base::parse;
+    using ecci::ecci_base::reset;
+
+    ecci::ecci_base &
+    reset() override
+    {
+        code.clear();
+        loops.clear();
+        pending.clear();
+        shift = 0;
+        clear();
+        instrument().clear();
+        profile(nullptr);
+        return *this;
+    }
+
+    ecci::ecci_base &
+    parse(const char *first, const char *last) override
+    {
+        auto phase = instrument().phase("parse");
+        if (!good()) { return *this; }
+
+        for (; first != last; ++first)
+        {
+            switch (*first)
+            {
+              case '+': add(1);  break;
+              case '-': add(-1); break;
+              case '>': move(1);  break;
+              case '<': move(-1); break;
+
+              case '.':
+                flush_adds();
+                code.push_back({ insn::OUT, 0, shift });
+                break;
+
+              case ',':
+                flush_adds();
+                code.push_back({ insn::IN, 0, shift });
+                break;
+
+              case '[':
+                flush();
+                loops.push_back(code.size());
+                code.push_back({ insn::OPEN, 0, 0 });
+                break;
+
+              case ']':
+                if (loops.empty()) { return fail(ecci::errc::syntax_error, "unmatched ]"); }
+                close_loop();
+                break;
+            }
+        }
+        return *this;
+    }
+
+    ecci::ecci_base &
+    compile() override
+    {
+        if (!good()) { return *this; }
+
+        flush();
+        if (!loops.empty()) { return fail(ecci::errc::syntax_error, "unmatched ["); }
+        return *this;
+    }
+
+    void
+    save(std::ostream &os) const override
+    {
+        using ecci::detail::put_word;
+        put_word(os, version);
+        put_word(os, code.size());
+        for (auto &i : code)
+        {
+            put_word(os, i.op);
+            put_word(os, i.arg);
+            put_word(os, i.offset);
+        }
+    }
+
+    ecci::ecci_base &
+    load(std::istream &is) override;
+
+    ecci::ecci_base &
+    run() override;
+
+private:
+    // bumped whenever the serialized layout changes
+    static constexpr std::uint32_t version = 1;
+
+    static bool
+    in_reach(std::int32_t x) noexcept
+    {
+        return -max_offset <= x && x <= max_offset;
+    }
+
+    void
+    add(int delta)
+    {
+        for (auto &p : pending)
+        {
+            if (p.first == shift)
+            {
+                p.second += delta;
+                return;
+            }
+        }
+        pending.emplace_back(shift, delta);
+    }
+
+    void
+    move(int delta)
+    {
+        if (!in_reach(shift + delta)) { flush(); }
+        shift += delta;
+    }
+
+    void
+    flush_adds()
+    {
+        for (auto &p : pending)
+        {
+            const std::int32_t delta = static_cast<unsigned char>(p.second);
+            if (delta) { code.push_back({ insn::ADD, delta, p.first }); }
+        }
+        pending.clear();
+    }
+
+    void
+    flush()
+    {
+        flush_adds();
+        if (shift) { code.push_back({ insn::MOVE, shift, 0 }); }
+        shift = 0;
+    }
+
+    void
+    close_loop();
+
+    std::vector<insn>                         code;
+    std::vector<std::size_t>                  loops;
+    std::vector<std::pair<std::int32_t, int>> pending;
+    std::int32_t                              shift = 0;
+
+    std::vector<unsigned char>                tape;
+};
+
+inline void
+interpreter::close_loop()
+{
+    flush_adds();
+    const std::size_t open = loops.back();
+    loops.pop_back();
+
+    bool only_adds = shift == 0;
+    std::int32_t counter = 0;
+    for (auto i = open + 1; only_adds && i != code.size(); ++i)
+    {
+        only_adds = code[i].op == insn::ADD;
+        if (only_adds && code[i].offset == 0) { counter = code[i].arg; }
+    }
+
+    // [-] and [->+>++<<]: each iteration steps the counter by one
+    if (only_adds && (counter == 1 || counter == 255))
+    {
+        std::vector<insn> body(code.begin() + open + 1, code.end());
+        code.resize(open);
+        for (auto &i : body)
+        {
+            if (i.offset == 0) { continue; }
+            const std::int32_t factor = counter == 255 ? i.arg : 256 - i.arg;
+            code.push_back({ insn::MULADD, factor & 0xff, i.offset });
+        }
+        code.push_back({ insn::CLEAR, 0, 0 });
+        return;
+    }
+
+    // [>] and [<<]
+    if (open + 1 == code.size() && shift != 0)
+    {
+        code.back() = { insn::SCAN, shift, 0 };
+        shift = 0;
+        return;
+    }
+
+    flush();
+    code[open].arg = code.size();
+    code.push_back({ insn::CLOSE, std::int32_t(open), 0 });
+}
+
+inline ecci::ecci_base &
+interpreter::load(std::istream &is)
+{
+    auto phase = instrument().phase("load");
+    if (!good()) { return *this; }
+
+    using ecci::detail::get_word;
+    std::uint32_t ver, n;
+    if (!get_word(is, ver) || ver != version || !get_word(is, n))
+    {
+        return fail(ecci::errc::broken_program, "broken compiled program");
+    }
+
+    flush();
+    const std::size_t base = code.size();
+    std::vector<insn> loaded;
+    std::vector<std::size_t> open;
+    for (std::size_t pc = 0; pc != n; ++pc)
+    {
+        std::uint32_t op, arg, offset;
+        if (!get_word(is, op) || !get_word(is, arg) || !get_word(is, offset) || op >= insn::_SIZE)
+        {
+            return fail(ecci::errc::broken_program, "broken compiled program");
+        }
+
+        insn i = { insn::op_t(op), std::int32_t(arg), std::int32_t(offset) };
+        bool valid = in_reach(i.offset);
+        switch (i.op)
+        {
+          case insn::MOVE:
+          case insn::SCAN:
+            valid = valid && i.arg != 0 && in_reach(i.arg);
+            break;
+
+          case insn::OPEN:
+            open.push_back(pc);
+            break;
+
+          case insn::CLOSE:
+            valid = valid && !open.empty() && std::size_t(i.arg) == open.back()
+                 && loaded[open.back()].arg == std::int32_t(pc);
+            if (valid)
+            {
+                loaded[open.back()].arg += base;
+                i.arg += base;
+                open.pop_back();
+            }
+            break;
+
+          default:
+            break;
+        }
+        if (!valid) { return fail(ecci::errc::broken_program, "broken compiled program"); }
+        loaded.push_back(i);
+    }
+    if (!open.empty()) { return fail(ecci::errc::broken_program, "broken compiled program"); }
+
+    code.insert(code.end(), loaded.begin(), loaded.end());
+    return *this;
+}
+
+// The tape keeps max_offset spare cells on both sides of the reachable
+// ones, so that offset operands need no bounds checks.  It grows to the
+// right on demand; moving left of the first cell is an error.
+inline ecci::ecci_base &
+interpreter::run()
+{
+    compile();
+
+    auto phase = instrument().phase("run");
+    if (!good()) { return *this; }
+
+    const std::ptrdiff_t pad = max_offset;
+    tape.assign(std::max<std::size_t>(tape.size(), 1 << 16), 0);
+    auto *t = tape.data();
+    std::ptrdiff_t p = pad, size = tape.size();
+
+    auto grow = [&](std::ptrdiff_t need)
+    {
+        tape.resize(std::max(2 * size, need + pad + 1), 0);
+        t    = tape.data();
+        size = tape.size();
+    };
+
+    std::streambuf *isb = in().rdbuf(), *osb = out().rdbuf();
+    const insn *pc = code.data(), *const start = pc, *const end = pc + code.size();
+    for (; pc != end; ++pc)
+    {
+        switch (pc->op)
+        {
+          case insn::ADD:
+            t[p + pc->offset] += pc->arg;
+            break;
+
+          case insn::MOVE:
+            p += pc->arg;
+            if (p < pad) { return fail(ecci::errc::runtime_error, "moved left of the first cell"); }
+            if (p + pad >= size) { grow(p); }
+            break;
+
+          case insn::OUT:
+            if (!osb || osb->sputc(t[p + pc->offset]) == EOF)
+            {
+                return fail(ecci::errc::runtime_error, "output error");
+            }
+            break;
+
+          case insn::IN:
+            if (isb)
+            {
+                const int c = isb->sbumpc();
+                if (c != EOF) { t[p + pc->offset] = c; }
+            }
+            break;
+
+          case insn::OPEN:
+            if (!t[p]) { pc = start + pc->arg; }
+            break;
+
+          case insn::CLOSE:
+            if (t[p]) { pc = start + pc->arg; }
+            break;
+
+          case insn::CLEAR:
+            t[p + pc->offset] = 0;
+            break;
+
+          case insn::MULADD:
+            t[p + pc->offset] += t[p] * pc->arg;
+            break;
+
+          case insn::SCAN:
+            if (pc->arg == 1)
+            {
+                p = detail::find_zero(t, p, size);
+                if (p == size) { grow(p); }
+            }
+            else if (pc->arg == -1)
+            {
+                p = detail::rfind_zero(t, p, pad);
+            }
+            else
+            {
+                while (p >= pad && p < size && t[p]) { p += pc->arg; }
+                if (p >= size) { grow(p); }
+            }
+            if (p < pad) { return fail(ecci::errc::runtime_error, "moved left of the first cell"); }
+            if (p + pad >= size) { grow(p); }
+            break;
+
+          default:
+            break;
+        }
+    }
+    return *this;
+}
+
+} // namespace bf
+
+#endif // esolang_bf_hpp_
@@ -0,0 +1,313 @@
+// Esolang compiler collections interpreter - cache.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_cache_hpp_
+#define esolang_cache_hpp_
+
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "ecci.hpp"
+
+namespace ecci {
+
+namespace detail {
+
+// SHA-256 (FIPS 180-4), enough to name cache entries.
+class sha256
+{
+    std::uint32_t h[8];
+    unsigned char buf[64];
+    std::size_t   nbuf = 0;
+    std::uint64_t nbits = 0;
+
+    static std::uint32_t
+    rotr(std::uint32_t x, int n) noexcept { return (x >> n) | (x << (32 - n)); }
+
+    void
+    block(const unsigned char *p) noexcept
+    {
+        static const std::uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        std::uint32_t w[64];
+        for (int i = 0; i != 16; ++i)
+        {
+            w[i] = std::uint32_t(p[4 * i]) << 24 | std::uint32_t(p[4 * i + 1]) << 16
+                 | std::uint32_t(p[4 * i + 2]) << 8 | p[4 * i + 3];
+        }
+        for (int i = 16; i != 64; ++i)
+        {
+            const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i != 64; ++i)
+        {
+            const auto t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            const auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+public:
+    sha256() noexcept
+      : h{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+           0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }
+    {}
+
+    sha256 &
+    update(const char *first, const char *last) noexcept
+    {
+        nbits += std::uint64_t(last - first) * 8;
+        while (first != last)
+        {
+            const std::size_t n = std::min<std::size_t>(64 - nbuf, last - first);
+            std::copy(first, first + n, buf + nbuf);
+            first += n;
+            if ((nbuf += n) == 64)
+            {
+                block(buf);
+                nbuf = 0;
+            }
+        }
+        return *this;
+    }
+
+    // Lowercase hex of the digest; the object is spent afterwards.
+    std::string
+    hex()
+    {
+        const std::uint64_t bits = nbits;
+        const char pad[64] = { char(0x80) };
+        update(pad, pad + (nbuf < 56 ? 56 - nbuf : 120 - nbuf));
+
+        char len[8];
+        for (int i = 0; i != 8; ++i) { len[i] = char(bits >> (56 - 8 * i)); }
+        update(len, len + 8);
+
+        static const char digits[] = "0123456789abcdef";
+        std::string s;
+        for (auto x : h)
+        {
+            for (int i = 28; i >= 0; i -= 4) { s += digits[(x >> i) & 0xf]; }
+        }
+        return s;
+    }
+};
+
+} // namespace ecci::detail
+
+// On-disk cache of compiled programs keyed by language and source content.
+// Entries are written to a temporary file and renamed into place, so
+// concurrent runs never observe a partial entry.  Once the directory grows
+// beyond the size limit the least recently used entries are evicted.
+class program_cache
+{
+    static constexpr std::size_t   magic_size = 4;
+    static constexpr std::uint32_t version    = 2;
+
+    static const char *
+    magic() noexcept { return "ecci"; }
+
+    std::string    dir;
+    std::uintmax_t limit;
+
+    static bool
+    make_directories(const std::string &path)
+    {
+        for (std::string::size_type pos = 1; pos != std::string::npos; ++pos)
+        {
+            pos = path.find('/', pos);
+            const std::string sub = path.substr(0, pos);
+            if (::mkdir(sub.c_str(), 0755) < 0 && errno != EEXIST) { return false; }
+            if (pos == std::string::npos) { break; }
+        }
+        return true;
+    }
+
+    std::string
+    path(const std::string &key) const { return dir + '/' + key + ".ecc"; }
+
+    void
+    evict() const
+    {
+        struct entry
+        {
+            std::string    path;
+            std::time_t    mtime;
+            std::uintmax_t size;
+        };
+        std::vector<entry> entries;
+        std::uintmax_t total = 0;
+
+        DIR *d = ::opendir(dir.c_str());
+        if (!d) { return; }
+        while (const ::dirent *e = ::readdir(d))
+        {
+            const std::string name = e->d_name;
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".ecc") != 0) { continue; }
+
+            struct stat st;
+            const std::string p = dir + '/' + name;
+            if (::stat(p.c_str(), &st) < 0) { continue; }
+            entries.push_back({ p, st.st_mtime, std::uintmax_t(st.st_size) });
+            total += st.st_size;
+        }
+        ::closedir(d);
+
+        if (total <= limit) { return; }
+        std::sort(entries.begin(), entries.end(), [](const entry &a, const entry &b)
+        {
+            return a.mtime < b.mtime;
+        });
+        for (auto &e : entries)
+        {
+            if (total <= limit) { break; }
+            if (::unlink(e.path.c_str()) == 0) { total -= e.size; }
+        }
+    }
+
+public:
+    explicit
+    program_cache(std::string directory = default_directory(),
+                  std::uintmax_t size_limit = 64 << 20)
+      : dir(std::move(directory)), limit(size_limit)
+    {}
+
+    // $ECCI_CACHE_DIR, else $XDG_CACHE_HOME/ecci, else $HOME/.cache/ecci.
+    static std::string
+    default_directory()
+    {
+        if (const char *p = std::getenv("ECCI_CACHE_DIR")) { return p; }
+        if (const char *p = std::getenv("XDG_CACHE_HOME")) { return std::string(p) + "/ecci"; }
+        if (const char *p = std::getenv("HOME")) { return std::string(p) + "/.cache/ecci"; }
+        return std::string();
+    }
+
+    const std::string &
+    directory() const noexcept { return dir; }
+
+    // SHA-256 of the language name and the source.  The key is stored in
+    // the entry as well, and load() checks it.
+    static std::string
+    key(const std::string &lang, const char *first, const char *last)
+    {
+        return detail::sha256().update(lang.data(), lang.data() + lang.size() + 1)
+                               .update(first, last).hex();
+    }
+
+    // Loads the entry for key into interp; false on miss or broken entry.
+    bool
+    load(const std::string &key, ecci_base &interp) const
+    {
+        if (dir.empty()) { return false; }
+
+        const std::string p = path(key);
+        std::ifstream is(p, std::ios::binary);
+        char m[magic_size];
+        std::uint32_t ver;
+        std::string stored(key.size(), '\0');
+        if (!is.read(m, magic_size) || !std::equal(m, m + magic_size, magic())
+         || !detail::get_word(is, ver) || ver != version
+         || !is.read(&stored[0], stored.size()) || stored != key)
+        {
+            return false;
+        }
+
+        // a corrupted entry may also make the interpreter run out of memory
+        bool ok;
+        try { ok = interp.load(is).good(); }
+        catch (...) { ok = false; }
+        if (!ok)
+        {
+            interp.clear();
+            ::unlink(p.c_str());
+            return false;
+        }
+
+        // keep recently used entries away from eviction
+        ::utime(p.c_str(), nullptr);
+        return true;
+    }
+
+    // Stores the compiled program of interp; false if it could not be written.
+    bool
+    store(const std::string &key, const ecci_base &interp) const
+    {
+        if (dir.empty() || !make_directories(dir)) { return false; }
+
+        const std::string p   = path(key);
+        const std::string tmp = p + ".tmp." + std::to_string(::getpid());
+        {
+            std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+            os.write(magic(), magic_size);
+            detail::put_word(os, version);
+            os.write(key.data(), key.size());
+            interp.save(os);
+            if (!os.flush())
+            {
+                ::unlink(tmp.c_str());
+                return false;
+            }
+        }
+
+        if (std::rename(tmp.c_str(), p.c_str()) != 0)
+        {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        evict();
+        return true;
+    }
+};
+
+} // namespace ecci
+
+#endif // esolang_cache_hpp_
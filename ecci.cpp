@@ -0,0 +1,368 @@
+// Esolang compiler collections interpreter - ecci.cpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ecci.hpp"
+#include "cache.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
+#include "memory.hpp"
+#include "grass/gri.hpp"
+#include "hq9+/hq9+.hpp"
+#include "brainfuck/bf.hpp"
+
+namespace {
+
+struct language
+{
+    const char *name;
+    const char *const *extensions;
+    std::unique_ptr<ecci::ecci_base> (*make)();
+};
+
+template <typename Interpreter>
+std::unique_ptr<ecci::ecci_base>
+make_interpreter()
+{
+    return ecci::make_unique_ptr<Interpreter>();
+}
+
+const char *const grass_ext[] = { ".grass", ".gs", nullptr };
+const char *const hq9p_ext[]  = { ".hq9+", ".hq9p", ".hq9", nullptr };
+const char *const bf_ext[]    = { ".bf", ".b", nullptr };
+
+const language languages[] = {
+    { "grass", grass_ext, &make_interpreter<grass::interpreter> },
+    { "hq9+",  hq9p_ext,  &make_interpreter<hq9p::interpreter> },
+    { "brainfuck", bf_ext, &make_interpreter<bf::interpreter> },
+};
+
+const language *
+find_language(const std::string &name)
+{
+    for (auto &lang : languages)
+    {
+        if (name == lang.name) { return &lang; }
+    }
+    return nullptr;
+}
+
+bool
+ends_with(const std::string &s, const char *suffix)
+{
+    const std::size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Guess from the file name first, then from which instruction set
+// dominates the source.
+const language *
+detect_language(const std::string &path, const char *first, const char *last)
+{
+    for (auto &lang : languages)
+    {
+        for (auto ext = lang.extensions; *ext; ++ext)
+        {
+            if (ends_with(path, *ext)) { return &lang; }
+        }
+    }
+
+    std::size_t grass = 0, hq9p = 0, bf = 0;
+    std::for_each(first, last, [&](char c)
+    {
+        switch (c)
+        {
+          case 'w': case 'W': case 'v':
+            ++grass;
+            break;
+
+          case 'H': case 'Q': case '9':
+            ++hq9p;
+            break;
+
+          case '+':
+            ++hq9p;
+            ++bf;
+            break;
+
+          case '-': case '<': case '>': case '[': case ']': case '.': case ',':
+            ++bf;
+            break;
+        }
+    });
+
+    if (grass > hq9p && grass > bf) { return find_language("grass"); }
+    if (hq9p > grass && hq9p > bf)  { return find_language("hq9+"); }
+    if (bf > grass && bf > hq9p)    { return find_language("brainfuck"); }
+    return nullptr;
+}
+
+class mapped_file
+{
+    const char *addr;
+    std::size_t len;
+
+public:
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &
+    operator=(const mapped_file &) = delete;
+
+    explicit
+    mapped_file(const std::string &path)
+      : addr(nullptr), len(0)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw ecci::ecci_error("ecci", path + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0)
+        {
+            int err = errno;
+            ::close(fd);
+            throw ecci::ecci_error("ecci", path + ": " + std::strerror(err));
+        }
+
+        len = st.st_size;
+        if (len != 0)
+        {
+            void *p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                int err = errno;
+                ::close(fd);
+                throw ecci::ecci_error("ecci", path + ": " + std::strerror(err));
+            }
+            ::madvise(p, len, MADV_SEQUENTIAL);
+            addr = static_cast<const char *>(p);
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file() noexcept
+    {
+        if (addr) { ::munmap(const_cast<char *>(addr), len); }
+    }
+
+    const char *
+    begin() const noexcept { return addr; }
+
+    const char *
+    end() const noexcept { return addr + len; }
+
+    std::size_t
+    size() const noexcept { return len; }
+};
+
+void
+usage(std::ostream &os, const char *argv0)
+{
+    os << "usage: " << argv0 << " [options] <source>...\n"
+          "  several sources run as a pipeline, each feeding its output to the next\n"
+          "  -l, --lang <name>      source language (grass, hq9+, brainfuck)\n"
+          "      --time             report wall time of parse and run\n"
+          "      --stats            report wall/cpu time and hardware counters of each phase\n"
+          "      --cache-dir <dir>  directory of the compiled-program cache\n"
+          "      --no-cache         always compile from source\n"
+          "      --reach <n>        promise that Grass toplevels refer at most n\n"
+          "                         toplevels back, so older values can be freed\n"
+          "      --profile <file>   sample the run and write folded stacks of\n"
+          "                         toplevel indices for flame graph tools\n"
+          "                         (single source only)\n"
+          "  -h, --help             show this message\n";
+}
+
+struct stage
+{
+    std::string                      path;
+    std::unique_ptr<mapped_file>     src;
+    const language                  *lang;
+    std::unique_ptr<ecci::ecci_base> interp;
+    bool                             hit;
+};
+
+} // namespace <anonymous-namespace>
+
+int main(int argc, char **argv) try
+{
+    const language *lang = nullptr;
+    bool time = false, stats = false, use_cache = true;
+    std::vector<std::string> paths;
+    std::string profile_path, cache_dir = ecci::program_cache::default_directory();
+    std::size_t reach = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-l" || arg == "--lang")
+        {
+            if (++i == argc || !(lang = find_language(argv[i])))
+            {
+                std::cerr << argv[0] << ": unknown language"
+                          << (i < argc ? std::string(" '") + argv[i] + "'" : "") << '\n';
+                return 2;
+            }
+        }
+        else if (arg == "--time") { time = true; }
+        else if (arg == "--stats") { time = stats = true; }
+        else if (arg == "--no-cache") { use_cache = false; }
+        else if (arg == "--cache-dir" && i + 1 < argc) { cache_dir = argv[++i]; }
+        else if (arg == "--profile" && i + 1 < argc) { profile_path = argv[++i]; }
+        else if (arg == "--reach" && i + 1 < argc)
+        {
+            char *end;
+            reach = std::strtoul(argv[++i], &end, 10);
+            if (*end || reach == 0)
+            {
+                std::cerr << argv[0] << ": invalid reach '" << argv[i] << "'\n";
+                return 2;
+            }
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            usage(std::cout, argv[0]);
+            return 0;
+        }
+        else if (!arg.empty() && arg[0] != '-') { paths.push_back(arg); }
+        else
+        {
+            usage(std::cerr, argv[0]);
+            return 2;
+        }
+    }
+
+    if (paths.empty() || (paths.size() > 1 && !profile_path.empty()))
+    {
+        usage(std::cerr, argv[0]);
+        return 2;
+    }
+
+    const ecci::program_cache cache(use_cache ? cache_dir : std::string());
+    std::vector<stage> stages;
+    for (auto &path : paths)
+    {
+        stage s{ path, ecci::make_unique_ptr<mapped_file>(path), lang, nullptr, false };
+        if (!s.lang && !(s.lang = detect_language(path, s.src->begin(), s.src->end())))
+        {
+            std::cerr << argv[0] << ": " << path << ": cannot detect language, use --lang\n";
+            return 2;
+        }
+
+        s.interp = s.lang->make();
+        if (time) { s.interp->instrument().enable(stats); }
+        if (reach)
+        {
+            if (auto *g = dynamic_cast<grass::interpreter *>(s.interp.get())) { g->bound_reach(reach); }
+        }
+
+        const auto key = ecci::program_cache::key(s.lang->name, s.src->begin(), s.src->end());
+        s.hit = cache.load(key, *s.interp);
+        if (!s.hit && s.interp->parse(s.src->begin(), s.src->end()).compile().good())
+        {
+            cache.store(key, *s.interp);
+        }
+        stages.push_back(std::move(s));
+    }
+
+    ecci::stack_profile prof;
+    if (stages.size() > 1)
+    {
+        ecci::pipeline p;
+        for (auto &s : stages) { p.add(*s.interp); }
+        p.run(std::cin, std::cout);
+    }
+    else if (profile_path.empty()) { stages[0].interp->run(); }
+    else
+    {
+        auto &interp = stages[0].interp;
+        interp->profile(&prof);
+        {
+            ecci::sampler s(prof);
+            if (!s.running())
+            {
+                std::cerr << argv[0] << ": cannot start the sampling profiler\n";
+            }
+            interp->run();
+        }
+        interp->profile(nullptr);
+    }
+
+    stages.back().interp->out().flush();
+    if (time)
+    {
+        std::cerr << '\n';
+        for (auto &s : stages)
+        {
+            if (stages.size() > 1) { std::cerr << s.path << ":\n"; }
+            if (stats)
+            {
+                std::cerr << "language: " << s.lang->name << ", source: " << s.src->size() << " bytes"
+                          << ", cache: " << (!use_cache ? "off" : s.hit ? "hit" : "miss") << '\n';
+            }
+            s.interp->instrument().report(std::cerr, stats);
+        }
+    }
+
+    if (!profile_path.empty())
+    {
+        std::ofstream os(profile_path);
+        prof.report(os, stages[0].lang->name);
+        if (!os.flush())
+        {
+            throw ecci::ecci_error("ecci", profile_path + ": cannot write the profile");
+        }
+        if (prof.dropped())
+        {
+            std::cerr << argv[0] << ": " << prof.dropped() << " samples dropped\n";
+        }
+    }
+
+    for (auto &s : stages)
+    {
+        if (!s.interp->good())
+        {
+            throw ecci::ecci_error(s.lang->name, s.interp->error().message());
+        }
+    }
+}
+catch (ecci::ecci_error &e)
+{
+    std::cerr << e.what() << std::endl;
+    return 1;
+}
@@ -25,21 +25,82 @@
 #include <istream>
 #include <ostream>
 #include <iostream>
-#include <sstream>
 
 #include <string>
+#include <cstdint>
 #include <stdexcept>
 
+#include "perf.hpp"
+#include "profile.hpp"
+
 namespace ecci {
 
+namespace detail {
+
+// Compiled programs are stored as little-endian 32-bit words.
+inline void
+put_word(std::ostream &os, std::uint32_t w)
+{
+    const char b[] = {
+        char(w & 0xff), char((w >> 8) & 0xff), char((w >> 16) & 0xff), char(w >> 24)
+    };
+    os.write(b, sizeof(b));
+}
+
+inline bool
+get_word(std::istream &is, std::uint32_t &w)
+{
+    unsigned char b[4];
+    if (!is.read(reinterpret_cast<char *>(b), sizeof(b))) { return false; }
+    w = b[0] | (b[1] << 8) | (b[2] << 16) | (std::uint32_t(b[3]) << 24);
+    return true;
+}
+
+} // namespace ecci::detail
+
+enum class errc
+{
+  success = 0,
+  syntax_error,
+  broken_program,
+  runtime_error,
+  not_implemented
+};
+
+// Outcome of an interpreter operation.  Messages are static strings so
+// that reporting a failure never allocates.
+class status
+{
+    errc        ec;
+    const char *msg;
+
+public:
+    constexpr
+    status() noexcept
+      : ec(errc::success), msg("")
+    {}
+
+    constexpr
+    status(errc c, const char *m) noexcept
+      : ec(c), msg(m)
+    {}
+
+    constexpr bool
+    ok() const noexcept { return ec == errc::success; }
+
+    constexpr errc
+    code() const noexcept { return ec; }
+
+    constexpr const char *
+    message() const noexcept { return msg; }
+};
+
 class ecci_error : public std::runtime_error
 {
     static inline std::string
     cat(const std::string &lang, const std::string &x)
     {
-        std::ostringstream ss;
-        ss << "ecci faltal (" << lang << "): " << x;
-        return ss.str();
+        return "ecci faltal (" + lang + "): " + x;
     }
 
 public:
@@ -51,45 +112,129 @@ public:
 
 class ecci_base
 {
-    std::istream &sin;
-    std::ostream &sout;
+    std::istream *sin;
+    std::ostream *sout;
+
+    instrumentation instr;
+    stack_profile  *prof = nullptr;
+
+    status st;
 
 protected:
-    constexpr explicit
+    explicit
     ecci_base(std::istream &in, std::ostream &out) noexcept
-      : sin(in), sout(out)
+      : sin(&in), sout(&out)
     {}
 
-    constexpr
     ecci_base() noexcept
       : ecci_base(std::cin, std::cout)
     {}
 
-    constexpr explicit
+    explicit
     ecci_base(std::iostream &inout) noexcept
       : ecci_base(inout, inout)
     {}
 
-    virtual ~ecci_base() noexcept {}
+    // Records the first failure only; later ones are usually its fallout.
+    ecci_base &
+    fail(errc c, const char *msg) noexcept
+    {
+        if (st.ok()) { st = status(c, msg); }
+        return *this;
+    }
+
+    ecci_base &
+    fail(const status &s) noexcept
+    {
+        return s.ok() ? *this : fail(s.code(), s.message());
+    }
 
 public:
+    virtual ~ecci_base() noexcept {}
+
+    // Interpreters report failures here instead of throwing; once failed,
+    // parse(), compile(), load() and run() do nothing until clear().
+    bool
+    good() const noexcept { return st.ok(); }
+
+    const status &
+    error() const noexcept { return st; }
+
+    void
+    clear() noexcept { st = status(); }
+
     std::istream &
-    in() noexcept { return sin; }
+    in() noexcept { return *sin; }
 
     const std::istream &
-    in() const noexcept { return sin; }
+    in() const noexcept { return *sin; }
 
     std::ostream &
-    out() noexcept { return sout; }
+    out() noexcept { return *sout; }
 
     const std::ostream &
-    out() const noexcept { return sout; }
+    out() const noexcept { return *sout; }
+
+    // Per-phase timings and hardware counters; enable before parsing.
+    instrumentation &
+    instrument() noexcept { return instr; }
+
+    const instrumentation &
+    instrument() const noexcept { return instr; }
+
+    // Shadow stack kept by run() for the sampling profiler, if the
+    // interpreter supports one; null to stop keeping it.  reset() drops it.
+    void
+    profile(stack_profile *p) noexcept { prof = p; }
 
+    stack_profile *
+    profile() const noexcept { return prof; }
+
+    // Feeds [first, last) to the front end.  Implementations must not
+    // retain the range after returning, so callers may pass a mapped file
+    // or any other transient buffer.
     virtual ecci_base &
-    parse(const std::string &) = 0;
+    parse(const char *first, const char *last) = 0;
+
+    ecci_base &
+    parse(const std::string &code)
+    {
+        return parse(code.data(), code.data() + code.size());
+    }
+
+    // Finishes the front end; afterwards the program can be saved or run.
+    virtual ecci_base &
+    compile() = 0;
+
+    // Serializes the compiled program.  Call compile() first.
+    virtual void
+    save(std::ostream &) const = 0;
+
+    // Appends a program written by save() as if its source had been parsed.
+    virtual ecci_base &
+    load(std::istream &) = 0;
 
     virtual ecci_base &
     run() = 0;
+
+    // Returns to the freshly constructed state, keeping allocated memory
+    // and the instrumentation settings for the next program.
+    virtual ecci_base &
+    reset() = 0;
+
+    ecci_base &
+    reset(std::istream &in, std::ostream &out)
+    {
+        rebind(in, out);
+        return reset();
+    }
+
+    void
+    rebind(std::istream &in, std::ostream &out) noexcept
+    {
+        sin  = &in;
+        sout = &out;
+    }
 };
 
 } // namespace ecci
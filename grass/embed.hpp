@@ -0,0 +1,232 @@
+// Esolang compiler collections interpreter - grass/embed.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_grass_embed_hpp_
+#define esolang_grass_embed_hpp_
+
+#if __cplusplus < 201402L
+#error "grass/embed.hpp requires C++14 or later"
+#endif
+
+#include <cstddef>
+
+#include "gri.hpp"
+
+// Compile-time Grass front end.  A source literal is parsed and lowered
+// during constant evaluation into a table of the same shape as
+// grass::program, so loading it costs a copy and no parsing.  A malformed
+// source makes the constant evaluation throw, which is a compile error.
+//
+//   GRASS_EMBED(hello, "wWWwwww...");
+//   interp.load(hello.get()).run();
+
+namespace grass {
+
+namespace embed {
+
+struct app_pair
+{
+    unsigned int first, second;
+};
+
+struct toplevel
+{
+    unsigned int arg_num;
+    std::size_t  first, last;
+    std::size_t  cfirst, clast;
+};
+
+struct extent
+{
+    std::size_t toplevels, pairs, captures;
+};
+
+template <std::size_t T, std::size_t P, std::size_t C>
+struct table
+{
+    static constexpr std::size_t toplevels = T, pairs = P, captures = C;
+
+    toplevel     top[T ? T : 1];
+    app_pair     pair[P ? P : 1];
+    unsigned int capture[C ? C : 1];
+
+    program
+    get() const
+    {
+        program p;
+        p.toplevel.reserve(T);
+        p.pairs.reserve(P);
+        p.captures.assign(capture, capture + C);
+        for (std::size_t i = 0; i != T; ++i)
+        {
+            p.toplevel.push_back({ top[i].arg_num, top[i].first, top[i].last,
+                                   top[i].cfirst, top[i].clast });
+        }
+        for (std::size_t i = 0; i != P; ++i)
+        {
+            p.pairs.emplace_back(pair[i].first, pair[i].second);
+        }
+        return p;
+    }
+};
+
+namespace detail {
+
+// In, w, Succ and Out
+constexpr std::size_t initial_env_size = 4;
+
+// Large enough for any program of an N - 1 characters long source.
+template <std::size_t N>
+struct builder
+{
+    toplevel     top[N];
+    app_pair     pair[N];
+    unsigned int capture[2 * N];
+    std::size_t  ntop = 0, npairs = 0, ncaptures = 0;
+};
+
+constexpr bool
+is_grass_char(char c) noexcept
+{
+    return c == 'w' || c == 'W' || c == 'v';
+}
+
+constexpr std::size_t
+skip(const char *src, std::size_t n, std::size_t i) noexcept
+{
+    while (i != n && !is_grass_char(src[i])) { ++i; }
+    return i;
+}
+
+// Length of the run starting at i; i is left at the next Grass character.
+constexpr std::size_t
+run(const char *src, std::size_t n, std::size_t &i) noexcept
+{
+    const char c = src[i];
+    std::size_t cnt = 0;
+    for (; (i = skip(src, n, i)) != n && src[i] == c; ++i) { ++cnt; }
+    return cnt;
+}
+
+// Same as program::lower.
+template <std::size_t N>
+constexpr unsigned int
+lower(builder<N> &b, const toplevel &top, unsigned int i, std::size_t k, std::size_t env_size)
+{
+    const std::size_t n = top.arg_num, locals = n + top.last - top.first;
+    if (i < n + k) { return n + k - 1 - i; }
+
+    const std::size_t outer = i - n - k;
+    if (outer >= env_size) { throw grass_error("reference out of range"); }
+
+    std::size_t j = top.cfirst;
+    while (j != b.ncaptures && b.capture[j] != outer) { ++j; }
+    if (j == b.ncaptures) { b.capture[b.ncaptures++] = outer; }
+    return locals + j - top.cfirst;
+}
+
+template <std::size_t N>
+constexpr builder<N>
+parse(const char (&src)[N])
+{
+    builder<N> b{};
+    const std::size_t n = N - 1;
+    std::size_t env_size = initial_env_size;
+
+    for (std::size_t i = skip(src, n, 0); i != n; i = skip(src, n, i))
+    {
+        if (src[i] == 'v')
+        {
+            ++i;
+            continue;
+        }
+
+        if (src[i] == 'W')
+        {
+            const std::size_t func = run(src, n, i);
+            if (i == n || src[i] != 'w') { throw grass_error("unexpected application terminate"); }
+            const std::size_t arg = run(src, n, i);
+            if (func > env_size || arg > env_size) { throw grass_error("reference out of range"); }
+
+            b.top[b.ntop++] = { 0, b.npairs, b.npairs + 1, 0, 0 };
+            b.pair[b.npairs++] = { unsigned(func - 1), unsigned(arg - 1) };
+            ++env_size;
+            continue;
+        }
+
+        toplevel top{ unsigned(run(src, n, i)), b.npairs, b.npairs, b.ncaptures, 0 };
+        while (i != n && src[i] != 'v')
+        {
+            if (src[i] != 'W') { throw grass_error("unexpected char in define function"); }
+            const std::size_t func = run(src, n, i);
+            if (i == n || src[i] != 'w') { throw grass_error("unexpected char in function args"); }
+            const std::size_t arg = run(src, n, i);
+            b.pair[b.npairs++] = { unsigned(func - 1), unsigned(arg - 1) };
+        }
+
+        top.last = b.npairs;
+        for (std::size_t k = 0; k != top.last - top.first; ++k)
+        {
+            auto &p = b.pair[top.first + k];
+            p = { lower(b, top, p.first, k, env_size), lower(b, top, p.second, k, env_size) };
+        }
+        top.clast = b.ncaptures;
+        b.top[b.ntop++] = top;
+        ++env_size;
+    }
+    return b;
+}
+
+} // namespace grass::embed::detail
+
+template <std::size_t N>
+constexpr extent
+measure(const char (&src)[N])
+{
+    const auto b = detail::parse(src);
+    return { b.ntop, b.npairs, b.ncaptures };
+}
+
+template <std::size_t T, std::size_t P, std::size_t C, std::size_t N>
+constexpr table<T, P, C>
+compile(const char (&src)[N])
+{
+    const auto b = detail::parse(src);
+    table<T, P, C> t{};
+    for (std::size_t i = 0; i != T; ++i) { t.top[i] = b.top[i]; }
+    for (std::size_t i = 0; i != P; ++i) { t.pair[i] = b.pair[i]; }
+    for (std::size_t i = 0; i != C; ++i) { t.capture[i] = b.capture[i]; }
+    return t;
+}
+
+} // namespace grass::embed
+
+} // namespace grass
+
+// Defines the constexpr table name compiled from the string literal src.
+#define GRASS_EMBED(name, src)                                              \
+    constexpr ::grass::embed::extent name##_extent_                         \
+      = ::grass::embed::measure(src);                                       \
+    constexpr auto name = ::grass::embed::compile<                          \
+        name##_extent_.toplevels, name##_extent_.pairs,                     \
+        name##_extent_.captures>(src)
+
+#endif // esolang_grass_embed_hpp_
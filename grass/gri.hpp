@@ -29,20 +29,24 @@
 #include <utility>
 #include <initializer_list>
 #include <vector>
-#include <set>
-#include <stack>
 
 #include <type_traits>
 #include <algorithm>
+#include <functional>
+#include <unordered_map>
 
 #include <string>
+#include <cstdint>
 #include <memory>
+#include <thread>
 #include "../memory.hpp"
 #include <iterator>
 
 #include "../ecci.hpp"
 
 #include <boost/throw_exception.hpp>
+#include <boost/iterator/filter_iterator.hpp>
+#include <boost/iterator/transform_iterator.hpp>
 
 namespace grass {
 
@@ -59,30 +63,18 @@ struct grass_error : public ecci::ecci_error
 
 namespace _lambda {
 
-struct lambda_error : public grass_error
-{
-    explicit
-    lambda_error(const std::string &x)
-      : grass_error(x)
-    {}
-};
-
 class lambda;
 
+typedef std::pair<unsigned int, unsigned int> app_pair_t;
+
+// A null lambda_ptr is how an application reports failure; the reason is
+// recorded in the lambda_pool.  References are validated at compile time,
+// so dereferencing is unchecked.
 class lambda_ptr
 {
 private:
     const lambda *ptr;
 
-    void
-    nullcheck() const
-    {
-        if (ptr == nullptr)
-        {
-            BOOST_THROW_EXCEPTION(lambda_error("null pointer"));
-        }
-    }
-
 public:
     explicit
     lambda_ptr(const lambda *ptr = nullptr) noexcept
@@ -99,232 +91,480 @@ public:
 
     explicit operator const lambda *() const noexcept { return get(); }
 
+    explicit operator bool() const noexcept { return ptr != nullptr; }
+
     const lambda &
-    operator*() const { return nullcheck(), *get(); }
+    operator*() const noexcept { return *get(); }
 
     const lambda *
-    operator->() const { return nullcheck(), get(); }
+    operator->() const noexcept { return get(); }
 };
 
-class lambda_pool : public std::set<const lambda *>
+// Owns every lambda created while a program runs.  Objects are placed in
+// an arena and never destroyed one by one: lambdas hold no resources, so
+// clear() just hands the memory back for the next program without going
+// through the allocator.  collect() moves the reachable ones to a fresh
+// arena and frees the rest.
+class lambda_pool
 {
-    std::vector<lambda_ptr> build_in_func;
+    ecci::arena mem;
+    std::size_t made = 0;
+
+    // What collect() could not free after a failure, kept until clear().
+    std::vector<std::unique_ptr<ecci::arena>> graveyard;
+
+    // While collect() runs: the chunks of the old arena, sorted, where
+    // the live objects in them went, and the copies left to relink.
+    typedef std::pair<const char *, const char *> span_t;
+    const std::vector<span_t>                          *from    = nullptr;
+    std::unordered_map<const lambda *, const lambda *> *to      = nullptr;
+
+    // What the last collect() kept; objects made since are not listed.
+    std::vector<lambda *> live;
+
+    static constexpr std::size_t min_collect = std::size_t(1) << 16;
+    std::size_t next_collect = min_collect;
+
+    ecci::status st;
 
 public:
-    enum class BUILDIN
+    // Call frames of user functions, each sized arg_num + body.size().
+    // Arguments are pushed here last one first before a real call.
+    std::vector<lambda_ptr> stack;
+
+    // Pairs of the running program, which user function bodies index.
+    const app_pair_t *code = nullptr;
+
+    // Shadow stack of definition indices for the sampling profiler.
+    ecci::stack_profile *prof = nullptr;
+
+    lambda_pool(const lambda_pool &) = delete;
+    lambda_pool &
+    operator=(const lambda_pool &) = delete;
+
+    lambda_pool() = default;
+
+    ~lambda_pool() noexcept { clear(); }
+
+    template <typename Lambda, typename... Args>
+    Lambda *
+    make(Args &&... args)
     {
-      // primitive
-      IN = 0,
-      W,
-      SUCC,
-      OUT,
+        return make_extended<Lambda>(0, std::forward<Args>(args)...);
+    }
 
-      // others
-      ID,
-      TRUE,
-      FALSE,
+    // Same as make(), with extra bytes placed right after the object.
+    template <typename Lambda, typename... Args>
+    Lambda *
+    make_extended(std::size_t extra, Args &&... args)
+    {
+        auto *pl = ::new (mem.allocate(sizeof(Lambda) + extra, alignof(Lambda)))
+            Lambda(std::forward<Args>(args)...);
+        ++made;
+        return pl;
+    }
 
-      _SIZE
-    };
+    // Drops every object; the arena keeps its memory.
+    void
+    clear() noexcept;
 
-    lambda_pool()
-      : build_in_func(std::size_t(BUILDIN::_SIZE))
-    { }
+    // Whether the pool has doubled since the last collect().
+    bool
+    crowded() const noexcept { return made >= next_collect; }
+
+    // Moves the objects reachable from the roots [first, last) to fresh
+    // memory, updating the roots, and drops the others.  Nothing but the
+    // roots may refer to the objects, so the stack must be empty.
+    void
+    collect(lambda_ptr *first, lambda_ptr *last);
+
+    // Where l goes; only for lambda::relink() during collect().
+    lambda_ptr
+    forward(const lambda_ptr &l);
+
+    // The objects the last collect() kept.
+    const std::vector<lambda *> &
+    survivors() const noexcept { return live; }
 
+    // Records the first runtime error and yields the failure value.
     lambda_ptr
-    operator[](BUILDIN buildin) const
+    fail(const char *msg) noexcept
     {
-        return build_in_func.at(std::size_t(buildin));
+        if (st.ok()) { st = ecci::status(ecci::errc::runtime_error, msg); }
+        return lambda_ptr();
     }
+
+    const ecci::status &
+    error() const noexcept { return st; }
 };
 
 } // namespace grass::_lambda
 
+// Global environment.  The slots below pin() stay for good; the others
+// can be retired once no remaining code refers to them.  Slot numbers
+// stay the same either way, and the storage of retired slots is given
+// back in bulk.
 class environment
-  : public std::stack<_lambda::lambda_ptr, std::vector<_lambda::lambda_ptr>>
 {
+    std::vector<_lambda::lambda_ptr> c;
+    std::size_t pinned = 0, dropped = 0, lowest = 0;
+
 public:
-    environment() = default;
+    void
+    push(const _lambda::lambda_ptr &l) { c.push_back(l); }
 
-    environment(const environment &env, std::size_t reserve = 0)
-      : std::stack<_lambda::lambda_ptr, std::vector<_lambda::lambda_ptr>>()
+    _lambda::lambda_ptr
+    top() const noexcept { return c.back(); }
+
+    std::size_t
+    size() const noexcept { return c.size() + dropped; }
+
+    // The slot idx below the top; it must not be retired.
+    _lambda::lambda_ptr
+    operator[](std::size_t idx) const noexcept
     {
-        c.reserve(env.size() + reserve);
-        c.assign(env.c.begin(), env.c.end());
+        const std::size_t slot = size() - idx - 1;
+        return c[slot < pinned ? slot : slot - dropped];
     }
 
-    _lambda::lambda_ptr
-    operator[](std::size_t idx) const { return c[size() - idx - 1]; }
+    void
+    pin() noexcept { pinned = lowest = size(); }
+
+    std::size_t
+    pinned_slots() const noexcept { return pinned; }
+
+    // Whether slot has been retired.
+    bool
+    retired(std::size_t slot) const noexcept { return slot >= pinned && slot < lowest; }
 
+    // Retires the unpinned slots below floor, as far as they exist yet.
     void
-    clear() { c.clear(); }
-};
+    retire(std::size_t floor)
+    {
+        floor = std::min(floor, size());
+        if (floor <= lowest) { return; }
+        lowest = floor;
 
-namespace _lambda {
+        // compact once the retired slots outnumber the live ones
+        const std::size_t n = lowest - pinned - dropped;
+        if (n >= 64 && n >= c.size() - pinned - n) { compact(); }
+    }
 
-class lambda
-{
-protected:
-    environment env;
+    // Drops the storage of every retired slot now.
+    void
+    compact() noexcept
+    {
+        const std::size_t n = lowest - pinned - dropped;
+        c.erase(c.begin() + pinned, c.begin() + pinned + n);
+        dropped += n;
+    }
 
-    lambda_pool *pool;
+    // The slots which are not retired, oldest first, once compacted.
+    _lambda::lambda_ptr *
+    begin() noexcept { return c.data(); }
 
-    lambda_ptr
-    operator[](std::size_t idx) { return env[idx + 1]; }
+    _lambda::lambda_ptr *
+    end() noexcept { return c.data() + c.size(); }
 
     void
-    push(const lambda_ptr &l) { env.push(l); }
+    clear() noexcept
+    {
+        c.clear();
+        pinned = dropped = lowest = 0;
+    }
+};
 
-    lambda_pool::value_type
-    insert(const lambda *l) const { return *pool->insert(l).first; }
+namespace _lambda {
 
+// Lambdas do not know the pool they live in; whoever applies them passes
+// the pool that receives the partial applications and characters they
+// create.  This lets the immutable builtins be shared by every interpreter.
+class lambda
+{
 public:
+    lambda() = default;
     lambda(const lambda &) = default;
     lambda(lambda &&) = default;
 
-    explicit
-    lambda(lambda_pool &pool) noexcept
-      : pool(&pool)
-    { }
-
     virtual ~lambda() noexcept { }
 
-    [[noreturn]] virtual lambda_ptr
-    real_call(std::vector<lambda_ptr> &&) const
+    // Applies this to the arguments on top of pool.stack and pops them.
+    virtual lambda_ptr
+    real_call(lambda_pool &pool) const
     {
-        BOOST_THROW_EXCEPTION(lambda_error("invalid real call"));
+        return pool.fail("invalid real call");
     }
 
     virtual lambda_ptr
-    operator()(const lambda_ptr &) const = 0;
+    operator()(const lambda_ptr &, lambda_pool &) const = 0;
+
+    // The character this lambda stands for, or -1 if it is not one.
+    virtual int
+    operator*() const noexcept { return -1; }
 
-    [[noreturn]] virtual char
-    operator*() const
+    // For lambda_pool::collect() on the lambdas a pool makes: relocate()
+    // copies this into pool, then relink() replaces every reference the
+    // copy holds with pool.forward() of it.
+    virtual const lambda *
+    relocate(lambda_pool &) const { return this; }
+
+    virtual void
+    relink(lambda_pool &) {}
+
+    // For moving the code of the running program: code() gives the range
+    // of pool.code this refers to, if any, and rebase() moves it.
+    virtual bool
+    code(std::size_t &, std::size_t &) const noexcept { return false; }
+
+    virtual void
+    rebase(std::size_t) noexcept {}
+};
+
+inline void
+lambda_pool::clear() noexcept
+{
+    mem.release();
+    made = 0;
+    live.clear();
+    graveyard.clear();
+    next_collect = min_collect;
+    stack.clear();
+    st = ecci::status();
+}
+
+inline void
+lambda_pool::collect(lambda_ptr *first, lambda_ptr *last)
+{
+    // allocate up front; past the swap, a failure has to keep the old objects
+    std::vector<span_t> old;
+    mem.for_each_chunk([&](const char *f, const char *l) { old.emplace_back(f, l); });
+    std::sort(old.begin(), old.end());
+    std::unordered_map<const lambda *, const lambda *> moved;
+    auto space = ecci::make_unique_ptr<ecci::arena>();
+    graveyard.reserve(graveyard.size() + 1);
+
+    mem.swap(*space);
+    made = 0;
+    live.clear();
+    from = &old;
+    to   = &moved;
+    try
     {
-        BOOST_THROW_EXCEPTION(lambda_error("invalid reference"));
+        for (; first != last; ++first) { *first = forward(*first); }
+
+        // live grows as relink() reaches further objects
+        for (std::size_t i = 0; i != live.size(); ++i) { live[i]->relink(*this); }
     }
-};
+    catch (...)
+    {
+        // copies may still refer to old objects
+        from = nullptr, to = nullptr;
+        live.clear();
+        graveyard.push_back(std::move(space));
+        throw;
+    }
+    from = nullptr, to = nullptr;
+
+    next_collect = 2 * made;
+    if (next_collect < min_collect) { next_collect = min_collect; }
+}
+
+inline lambda_ptr
+lambda_pool::forward(const lambda_ptr &l)
+{
+    // anything outside the old chunks is a builtin or belongs to the interpreter
+    const char *p = reinterpret_cast<const char *>(l.get());
+    auto itr = std::upper_bound(from->begin(), from->end(), span_t(p, nullptr),
+                                [](const span_t &a, const span_t &b) { return a.first < b.first; });
+    if (itr == from->begin() || p >= (--itr)->second) { return l; }
+
+    auto &copy = (*to)[l.get()];
+    if (!copy)
+    {
+        copy = l->relocate(*this);
+        live.push_back(const_cast<lambda *>(copy));
+    }
+    return lambda_ptr(copy);
+}
 
-class partial_apply final : public lambda
+// Lambda taking arg_num arguments.  Applications short of them build
+// partial applications; the last one makes the real call.
+class function : public lambda
 {
+protected:
     const unsigned int arg_num;
-    const lambda_ptr   func, arg;
 
+    explicit
+    function(unsigned int num) noexcept
+      : arg_num(num)
+    { }
+
+public:
     lambda_ptr
-    real_call(std::vector<lambda_ptr> &&args) const override
+    operator()(const lambda_ptr &l, lambda_pool &pool) const override;
+};
+
+class partial_apply final : public function
+{
+    lambda_ptr func, arg;
+
+    lambda_ptr
+    real_call(lambda_pool &pool) const override
     {
-        args.push_back(arg);
-        return func->real_call(std::move(args));
+        pool.stack.push_back(arg);
+        return func->real_call(pool);
+    }
+
+    const lambda *
+    relocate(lambda_pool &pool) const override { return pool.make<partial_apply>(*this); }
+
+    void
+    relink(lambda_pool &pool) override
+    {
+        func = pool.forward(func);
+        arg  = pool.forward(arg);
     }
 
 public:
-    partial_apply(lambda_pool &pool, unsigned int num,
-                  const lambda_ptr &func, const lambda_ptr &arg) noexcept
-      : lambda(pool), arg_num(num), func(func), arg(arg)
+    partial_apply(unsigned int num, const lambda_ptr &func, const lambda_ptr &arg) noexcept
+      : function(num), func(func), arg(arg)
     { }
+};
 
-    lambda_ptr
-    operator()(const lambda_ptr &l) const override
+inline lambda_ptr
+function::operator()(const lambda_ptr &l, lambda_pool &pool) const
+{
+    if (arg_num == 1)
     {
-        if (arg_num == 1)
-        {
-            return func->real_call({ arg, l });
-        }
-
-        using ecci::make_unique_ptr;
-        auto pa = make_unique_ptr<partial_apply>(*pool, arg_num - 1, lambda_ptr(this), l);
-        pool->insert(pa.get());
-        return lambda_ptr(pa.release());
+        pool.stack.push_back(l);
+        return real_call(pool);
     }
-};
+    return lambda_ptr(pool.make<partial_apply>(arg_num - 1, lambda_ptr(this), l));
+}
 
-// user defined function
-class user : public lambda
+// user defined function, as a flat closure
+//
+// The body is the range [first, first + nbody) of the program's pairs,
+// which pool.code points to while running, lowered by program::lower:
+// operand a < arg_num + nbody names a slot of the call frame (arguments
+// first, then results), larger ones name captured()[a - arg_num - nbody].
+// The captures are stored right after the object.
+class user final : public function
 {
-    friend class grass::interpreter;
+    std::uint32_t       first;
+    const std::uint32_t nbody, ncaptured;
+    const std::uint32_t def;
 
-public:
-    typedef std::pair<unsigned int, unsigned int> app_pair_t;
-    typedef std::vector<app_pair_t> body_t;
+    const lambda_ptr *
+    captured() const noexcept { return reinterpret_cast<const lambda_ptr *>(this + 1); }
 
-protected:
-    typedef std::initializer_list<app_pair_t> init_body_t;
+    lambda_ptr
+    real_call(lambda_pool &pool) const override
+    {
+        if (pool.prof) { pool.prof->push(def); }
 
-    const unsigned int arg_num;
-    const body_t       body;
+        auto &frame = pool.stack;
+        const auto *body = pool.code + first;
+        const std::size_t locals = arg_num + nbody;
+        const std::size_t base   = frame.size() - arg_num;
 
-    user(const user &l)
-      : lambda(l), arg_num(l.arg_num - 1), body(l.body)
-    { }
+        // arguments arrive last one first
+        std::reverse(frame.begin() + base, frame.end());
+        frame.resize(base + locals);
 
-    lambda_ptr
-    real_call(std::vector<lambda_ptr> &&args) const
-    {
-        if (arg_num != args.size())
+        auto slot = [&](unsigned int a)
         {
-            BOOST_THROW_EXCEPTION(lambda_error("invalid argument number"));
-        }
-
-        environment renv(env, body.size() + arg_num);
-        for (auto &l : args) { renv.push(l); }
+            return a < locals ? frame[base + a] : captured()[a - locals];
+        };
 
-        for (auto &app : body)
+        auto ret = frame[base + arg_num - 1];
+        for (std::size_t k = 0; k != nbody; ++k)
         {
-            auto func = renv[app.first];
-            auto arg  = renv[app.second];
-            renv.push((*func)(arg));
+            ret = (*slot(body[k].first))(slot(body[k].second), pool);
+            if (!ret) { break; }
+            frame[base + arg_num + k] = ret;
         }
-        return renv.top();
+        frame.resize(base);
+
+        if (pool.prof) { pool.prof->pop(); }
+        return ret;
     }
 
-public:
-    user(lambda_pool &pool, unsigned int num, body_t &&il)
-      : lambda(pool), arg_num(num), body(std::move(il))
-    { }
+    const lambda *
+    relocate(lambda_pool &pool) const override
+    {
+        return pool.make_extended<user>(extent(ncaptured), arg_num, first, first + nbody, def,
+                                        captured(), captured() + ncaptured);
+    }
 
-    user(lambda_pool &pool, unsigned int num,
-      init_body_t &&il = init_body_t())
-      : lambda(pool), arg_num(num), body(std::move(il))
-    { }
+    void
+    relink(lambda_pool &pool) override
+    {
+        auto *c = const_cast<lambda_ptr *>(captured());
+        for (std::size_t i = 0; i != ncaptured; ++i) { c[i] = pool.forward(c[i]); }
+    }
 
-    virtual lambda_ptr
-    operator()(const lambda_ptr &l) const override
+    bool
+    code(std::size_t &f, std::size_t &l) const noexcept override
     {
-        if (arg_num == 1)
-        {
-            return real_call({ l });
-        }
+        f = first;
+        l = first + nbody;
+        return true;
+    }
+
+    void
+    rebase(std::size_t f) noexcept override { first = f; }
 
-        using ecci::make_unique_ptr;
-        auto pa = make_unique_ptr<partial_apply>(*pool, arg_num - 1, lambda_ptr(this), l);
-        pool->insert(pa.get());
-        return lambda_ptr(pa.release());
+public:
+    // Bytes to reserve after the object for n captures.
+    static constexpr std::size_t
+    extent(std::size_t n) noexcept { return n * sizeof(lambda_ptr); }
+
+    // Must be placed by lambda_pool::make_extended with extent() bytes.
+    template <typename InputIterator>
+    user(unsigned int num, std::size_t first, std::size_t last, std::uint32_t def,
+         InputIterator cfirst, InputIterator clast)
+      : function(num), first(first), nbody(last - first),
+        ncaptured(std::distance(cfirst, clast)), def(def)
+    {
+        std::uninitialized_copy(cfirst, clast, const_cast<lambda_ptr *>(captured()));
     }
 };
 
-struct id final : public user
+struct id final : public function
 {
-    explicit
-    id(lambda_pool &pool)
-      : user(pool, 1)
+    id() noexcept
+      : function(1)
     { }
-};
 
-class boolalpha final : public user
-{
-    static init_body_t &&
-    gen_body(bool b, init_body_t &&true_, init_body_t &&false_) noexcept
+    lambda_ptr
+    real_call(lambda_pool &pool) const override
     {
-        return std::move(b ? true_ : false_);
+        auto ret = pool.stack.back();
+        pool.stack.pop_back();
+        return ret;
     }
+};
+
+// true is \x.\y.x and false is \x.\y.y
+class boolalpha final : public function
+{
+    const bool b;
 
 public:
     explicit
-    boolalpha(lambda_pool &pool, bool b)
-      : user(pool, 2, gen_body(b, {{ 3, 2 }}, {}))
+    boolalpha(bool b) noexcept
+      : function(2), b(b)
+    { }
+
+    lambda_ptr
+    real_call(lambda_pool &pool) const override
     {
-        if (!b) { return; }
-        env.push(pool[lambda_pool::BUILDIN::ID]);
+        // arguments arrive last one first
+        auto &s = pool.stack;
+        auto ret = s[s.size() - (b ? 1 : 2)];
+        s.resize(s.size() - 2);
+        return ret;
     }
 };
 
@@ -333,19 +573,15 @@ namespace primitive {
 struct w final : public lambda
 {
     explicit
-    w(lambda_pool &pool, char x = 'w')
-      : lambda(pool), c(x)
+    w(char x = 'w') noexcept
+      : c(x)
     { }
 
     lambda_ptr
-    operator()(const lambda_ptr &l) const override
-    {
-        using BUILDIN = lambda_pool::BUILDIN;
-        return (*pool)[(**l == c) ? BUILDIN::TRUE : BUILDIN::FALSE];
-    }
+    operator()(const lambda_ptr &l, lambda_pool &) const override;
 
-    char
-    operator*() const noexcept override { return c; }
+    int
+    operator*() const noexcept override { return static_cast<unsigned char>(c); }
 
 private:
     const char c;
@@ -353,71 +589,316 @@ private:
 
 struct succ final : public lambda
 {
-    explicit
-    succ(lambda_pool &pool) noexcept
-      : lambda(pool)
-    { }
-
     lambda_ptr
-    operator()( const lambda_ptr &l ) const override
-    {
-        // FIXME: applicate singleton to character
-        return lambda_ptr(insert(new w(*pool, (**l + 1) % 256)));
-    }
+    operator()(const lambda_ptr &l, lambda_pool &pool) const override;
 };
 
 struct in final : public lambda
 {
     explicit
-    in(lambda_pool &pool, std::istream &in) noexcept
-      : lambda(pool), sin(in)
+    in(ecci::ecci_base &i) noexcept
+      : interp(i)
     { }
 
     lambda_ptr
-    operator()(const lambda_ptr &l) const override
-    {
-        int c = sin.get();
-        if (c == EOF) { return l; }
-
-        // FIXME: applicate singleton to character
-        return lambda_ptr(insert(new w(*pool, c)));
-    }
+    operator()(const lambda_ptr &l, lambda_pool &) const override;
 
 private:
-    std::istream &sin;
+    ecci::ecci_base &interp;
 };
 
 struct out final : public lambda
 {
     explicit
-    out(lambda_pool &pool, std::ostream &out, bool f = false) noexcept
-      : lambda(pool), sout(out), force(f)
+    out(ecci::ecci_base &i, bool f = false) noexcept
+      : interp(i), force(f)
     { }
 
     lambda_ptr
-    operator()(const lambda_ptr &l) const override
+    operator()(const lambda_ptr &l, lambda_pool &pool) const override
     {
-        try
+        const int c = **l;
+        if (c >= 0)
         {
-            sout.put(**l);
+            interp.out().put(c);
         }
-        catch (const lambda_error &)
+        else
         {
-            if (!force) { throw; }
-            sout << "<lambda>";
+            if (!force) { return pool.fail("output of non-character"); }
+            interp.out() << "<lambda>";
         }
         return l;
     }
 
 private:
-    std::ostream &sout;
+    ecci::ecci_base &interp;
     bool force;
 };
 
 } // namespace grass::_lambda::primitive
 
+// Immutable lambdas shared by every interpreter in the process: the
+// combinators and one w per character, so that In and Succ never allocate.
+class builtins
+{
+    id                       id_;
+    boolalpha                true_, false_;
+    primitive::succ          succ_;
+    std::vector<primitive::w> chars;
+
+    builtins()
+      : id_(), true_(true), false_(false), succ_()
+    {
+        chars.reserve(256);
+        for (int c = 0; c != 256; ++c) { chars.emplace_back(static_cast<char>(c)); }
+    }
+
+public:
+    builtins(const builtins &) = delete;
+    builtins &
+    operator=(const builtins &) = delete;
+
+    static const builtins &
+    get()
+    {
+        static const builtins instance;
+        return instance;
+    }
+
+    lambda_ptr
+    identity() const noexcept { return lambda_ptr(&id_); }
+
+    lambda_ptr
+    truth(bool b) const noexcept { return lambda_ptr(b ? &true_ : &false_); }
+
+    lambda_ptr
+    succ() const noexcept { return lambda_ptr(&succ_); }
+
+    lambda_ptr
+    character(int c) const noexcept { return lambda_ptr(&chars[c & 0xff]); }
+};
+
+namespace primitive {
+
+inline lambda_ptr
+w::operator()(const lambda_ptr &l, lambda_pool &) const
+{
+    return builtins::get().truth(**l == **this);
+}
+
+inline lambda_ptr
+succ::operator()(const lambda_ptr &l, lambda_pool &pool) const
+{
+    const int c = **l;
+    if (c < 0) { return pool.fail("succ applied to non-character"); }
+    return builtins::get().character(c + 1);
+}
+
+inline lambda_ptr
+in::operator()(const lambda_ptr &l, lambda_pool &) const
+{
+    int c = interp.in().get();
+    if (c == EOF) { return l; }
+    return builtins::get().character(c);
+}
+
+} // namespace grass::_lambda::primitive
+
 } // namespace grass::_lambda
 
+// Compiled form of a Grass source: toplevels in order, each owning the
+// range [first, last) of pairs.  A toplevel with arg_num == 0 is an
+// application evaluated in the global environment and keeps its de Bruijn
+// indices.  Functions are lowered to flat closures (see _lambda::user) and
+// own the range [cfirst, clast) of captures, the outer slots they reach,
+// counted from the top of the global environment at their definition.
+struct program
+{
+    typedef _lambda::app_pair_t app_pair_t;
+
+    struct toplevel_t
+    {
+        unsigned int arg_num;
+        std::size_t  first, last;
+        std::size_t  cfirst, clast;
+    };
+
+    // bumped whenever the serialized layout changes
+    static constexpr std::uint32_t version = 2;
+
+    std::vector<toplevel_t>   toplevel;
+    std::vector<app_pair_t>   pairs;
+    std::vector<unsigned int> captures;
+
+    void
+    clear() noexcept
+    {
+        toplevel.clear();
+        pairs.clear();
+        captures.clear();
+    }
+
+    // Sizes to cut the program back to when appended code is rejected.
+    struct mark_t
+    {
+        std::size_t ntop, npairs, ncaptures;
+    };
+
+    mark_t
+    mark() const noexcept { return { toplevel.size(), pairs.size(), captures.size() }; }
+
+    void
+    rollback(const mark_t &m)
+    {
+        toplevel.resize(m.ntop);
+        pairs.resize(m.npairs);
+        captures.resize(m.ncaptures);
+    }
+
+    void
+    save(std::ostream &) const;
+
+    bool
+    load(std::istream &);
+
+    // Parses every complete toplevel in [first, last), which must start at
+    // a toplevel boundary and yield only w, W and v, and appends them.
+    // Returns the position just past the last toplevel consumed.
+    template <typename ForwardIterator>
+    ForwardIterator
+    append(ForwardIterator first, ForwardIterator last, ecci::status &st);
+
+    // Rewrites the body of a function from de Bruijn indices to frame and
+    // capture slots and records its captures.
+    void
+    lower(toplevel_t &top)
+    {
+        const std::size_t n = top.arg_num, locals = n + top.last - top.first;
+        top.cfirst = captures.size();
+
+        auto slot = [&](unsigned int i, std::size_t k) -> unsigned int
+        {
+            if (i < n + k) { return n + k - 1 - i; }
+
+            const unsigned int outer = i - n - k;
+            auto itr = std::find(captures.begin() + top.cfirst, captures.end(), outer);
+            const std::size_t j = itr - (captures.begin() + top.cfirst);
+            if (itr == captures.end()) { captures.push_back(outer); }
+            return locals + j;
+        };
+
+        for (auto i = top.first; i != top.last; ++i)
+        {
+            // captures are numbered in order of appearance
+            const auto func = slot(pairs[i].first,  i - top.first);
+            const auto arg  = slot(pairs[i].second, i - top.first);
+            pairs[i] = app_pair_t(func, arg);
+        }
+        top.clast = captures.size();
+    }
+
+    // Appends the toplevels of p after ours.
+    void
+    splice(const program &p)
+    {
+        const auto base = pairs.size(), cbase = captures.size();
+        for (auto &top : p.toplevel)
+        {
+            toplevel.push_back({ top.arg_num, top.first + base, top.last + base,
+                                 top.cfirst + cbase, top.clast + cbase });
+        }
+        pairs.insert(pairs.end(), p.pairs.begin(), p.pairs.end());
+        captures.insert(captures.end(), p.captures.begin(), p.captures.end());
+    }
+
+    // Drops the first ntop toplevels, which ran, and puts kept, the code
+    // their functions still need, in front of the code of the others.
+    void
+    discard(std::size_t ntop, std::vector<app_pair_t> &kept)
+    {
+        const std::size_t first = ntop != toplevel.size() ? toplevel[ntop].first : pairs.size();
+        auto itr = std::find_if(toplevel.begin() + ntop, toplevel.end(), [](const toplevel_t &top)
+        {
+            return top.arg_num != 0;
+        });
+        const std::size_t cfirst = itr != toplevel.end() ? itr->cfirst : captures.size();
+
+        // allocate everything before changing anything
+        const std::size_t base = kept.size();
+        kept.insert(kept.end(), pairs.begin() + first, pairs.end());
+        std::vector<toplevel_t>   rest(toplevel.begin() + ntop, toplevel.end());
+        std::vector<unsigned int> crest(captures.begin() + cfirst, captures.end());
+
+        for (auto &top : rest)
+        {
+            top.first = top.first - first + base;
+            top.last  = top.last  - first + base;
+            // applications capture nothing
+            top.cfirst = top.arg_num != 0 ? top.cfirst - cfirst : 0;
+            top.clast  = top.arg_num != 0 ? top.clast  - cfirst : 0;
+        }
+        toplevel.swap(rest);
+        pairs.swap(kept);
+        captures.swap(crest);
+    }
+
+    // Calls f(i) for every slot of the global environment top refers to,
+    // i counted from the top of the environment at its definition.
+    template <typename F>
+    void
+    for_each_outer(const toplevel_t &top, F f) const
+    {
+        if (top.arg_num == 0)
+        {
+            for (auto i = top.first; i != top.last; ++i)
+            {
+                f(pairs[i].first);
+                f(pairs[i].second);
+            }
+            return;
+        }
+        for (auto i = top.cfirst; i != top.clast; ++i) { f(captures[i]); }
+    }
+
+    // Whether every reference of top stays within a global environment of
+    // env_size slots at the point it is defined, and within the frame.
+    bool
+    check(const toplevel_t &top, std::size_t env_size) const noexcept
+    {
+        if (top.arg_num == 0)
+        {
+            // an application adds exactly one slot
+            if (top.last - top.first != 1) { return false; }
+            for (auto i = top.first; i != top.last; ++i)
+            {
+                if (pairs[i].first >= env_size || pairs[i].second >= env_size) { return false; }
+            }
+            return true;
+        }
+
+        for (auto i = top.cfirst; i != top.clast; ++i)
+        {
+            if (captures[i] >= env_size) { return false; }
+        }
+
+        const std::size_t n      = top.arg_num;
+        const std::size_t locals = n + top.last - top.first;
+        const std::size_t slots  = locals + top.clast - top.cfirst;
+        auto valid = [&](unsigned int a, std::size_t k)
+        {
+            return a < n + k || (a >= locals && a < slots);
+        };
+        for (auto i = top.first; i != top.last; ++i)
+        {
+            if (!valid(pairs[i].first, i - top.first) || !valid(pairs[i].second, i - top.first))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 struct interpreter : public ecci::ecci_base
 {
     interpreter &
@@ -426,64 +907,244 @@ struct interpreter : public ecci::ecci_base
     operator=(interpreter &&) = delete;
 
 private:
+    // Builds the closure of a function toplevel from the global environment.
     _lambda::lambda_ptr
-    inserter(_lambda::lambda *pl)
-    try
+    inserter(const program::toplevel_t &top, std::uint32_t def)
     {
-        if (auto upl = dynamic_cast<_lambda::user *>(pl))
-        {
-            upl->env = env;
-        }
+        auto fetch = [this](unsigned int i) { return env[i]; };
+        auto cfirst = boost::make_transform_iterator(prog.captures.begin() + top.cfirst, fetch);
+        auto clast  = boost::make_transform_iterator(prog.captures.begin() + top.clast,  fetch);
 
-        _lambda::lambda_ptr lptr(pl);
+        _lambda::lambda_ptr lptr(pool.make_extended<_lambda::user>(
+            _lambda::user::extent(top.clast - top.cfirst),
+            top.arg_num, top.first, top.last, def, cfirst, clast));
         env.push(lptr);
-        pool.insert(pl);
         return lptr;
     }
-    catch (...)
+
+    bool
+    execute(const program::toplevel_t &top)
     {
-        delete pl;
-        throw;
+        auto first = prog.pairs.begin() + top.first;
+        auto last  = prog.pairs.begin() + top.last;
+        if (top.arg_num != 0)
+        {
+            inserter(top, discarded + executed);
+            return true;
+        }
+
+        for (; first != last; ++first)
+        {
+            auto ret = (*env[first->first])(env[first->second], pool);
+            if (!ret) { return false; }
+            env.push(ret);
+        }
+        return true;
     }
 
+    // Size of the global environment once every compiled toplevel ran.
+    std::size_t
+    pending_env_size() const noexcept
+    {
+        return env.size() + prog.toplevel.size() - executed;
+    }
+
+    // Nothing here allocates once the environment has grown before: In and
+    // Out are members and W and Succ are shared builtins.
     void
-    init(bool force_out)
+    init()
     {
         release();
 
-        using BUILDIN = _lambda::lambda_pool::BUILDIN;
-        namespace prim = _lambda::primitive;
-        pool[BUILDIN::IN]   = inserter(new prim::in(pool, in()));
-        pool[BUILDIN::W]    = inserter(new prim::w(pool));
-        pool[BUILDIN::SUCC] = inserter(new prim::succ(pool));
-        pool[BUILDIN::OUT]  = inserter(new prim::out(pool, out(), force_out));
+        const auto &b = _lambda::builtins::get();
+        env.push(_lambda::lambda_ptr(&input));
+        env.push(b.character('w'));
+        env.push(b.succ());
+        env.push(_lambda::lambda_ptr(&output));
+        env.pin();
     }
 
     void
     release() noexcept
     {
         env.clear();
-        for (const auto *ptr : pool)
+        pool.clear();
+    }
+
+    static bool
+    is_grass_char(char c) noexcept
+    {
+        return c == 'w' || c == 'W' || c == 'v';
+    }
+
+    // Whether top, defined with env_size slots, refers to a retired one.
+    bool
+    reaches_retired(const program &p, const program::toplevel_t &top, std::size_t env_size) const
+    {
+        bool r = false;
+        p.for_each_outer(top, [&](std::size_t i) { r = r || env.retired(env_size - 1 - i); });
+        return r;
+    }
+
+    // Retirement happens every this many toplevels, so that floors takes
+    // little room next to the program.
+    static constexpr std::size_t retire_interval = 1024;
+
+    // Fills floors[j] with the lowest unpinned slot that the toplevels from
+    // executed + (j + 1) * retire_interval on, the main application and the
+    // code to come within the reach bound may still refer to.
+    void
+    compute_floors()
+    {
+        const std::size_t n = prog.toplevel.size() - executed, last = env.size() + n;
+        floors.assign((n + retire_interval - 1) / retire_interval, 0);
+
+        std::size_t floor = last - std::min(last, std::max<std::size_t>(reach, 1));
+        for (std::size_t k = n; k-- != 0; )
         {
-            delete ptr;
+            // floor now covers the toplevels after k
+            if ((k + 1) % retire_interval == 0 || k + 1 == n) { floors[k / retire_interval] = floor; }
+
+            const std::size_t env_size = env.size() + k;
+            prog.for_each_outer(prog.toplevel[executed + k], [&](std::size_t i)
+            {
+                const std::size_t slot = env_size - 1 - i;
+                if (slot >= env.pinned_slots()) { floor = std::min(floor, slot); }
+            });
         }
-        pool.clear();
     }
 
-    void parser_impl();
+    // Toplevels that ran are dropped once there are at least this many and
+    // they outnumber both the live objects and the toplevels still to run,
+    // which bounds the cost of dropping them by the number that ran.
+    static constexpr std::size_t min_discard = std::size_t(1) << 16;
+
+    bool
+    stale() const noexcept
+    {
+        const std::size_t n = executed;
+        return n >= min_discard && n >= pool.survivors().size() && n >= prog.toplevel.size() - n;
+    }
+
+    // Between toplevels the global environment holds the only references
+    // to pool objects, and of the toplevels that ran only the bodies of the
+    // live functions are still needed.
+    void
+    collect()
+    {
+        env.compact();
+        const bool discard = stale();
+        pool.collect(env.begin(), env.end());
+        if (!discard) { return; }
+
+        // the bodies go first, so that the rest keeps its order; an empty
+        // body may start where another one does
+        std::vector<_lambda::app_pair_t>             kept;
+        std::unordered_map<std::size_t, std::size_t> moved;
+        std::size_t first, last;
+        for (auto *l : pool.survivors())
+        {
+            if (l->code(first, last) && first != last && moved.emplace(first, kept.size()).second)
+            {
+                kept.insert(kept.end(), prog.pairs.begin() + first, prog.pairs.begin() + last);
+            }
+        }
+        prog.discard(executed, kept);
+
+        for (auto *l : pool.survivors())
+        {
+            if (l->code(first, last)) { l->rebase(first != last ? moved.find(first)->second : 0); }
+        }
+        pool.code  = prog.pairs.data();
+        discarded += executed;
+        executed   = 0;
+    }
+
+    // Sources at least this large are split at toplevel boundaries and
+    // parsed on several threads.
+    static constexpr std::size_t parallel_chunk = std::size_t(1) << 20;
+
+    // Checks the toplevels from ntop on, which were appended to a program
+    // whose global environment had env_size slots.
+    bool
+    verify(std::size_t ntop, std::size_t env_size)
+    {
+        for (auto i = ntop; i != prog.toplevel.size(); ++i)
+        {
+            if (!prog.check(prog.toplevel[i], env_size + i - ntop))
+            {
+                fail(ecci::errc::syntax_error, "reference out of range");
+                return false;
+            }
+            if (reaches_retired(prog, prog.toplevel[i], env_size + i - ntop))
+            {
+                fail(ecci::errc::syntax_error, "reference to a retired toplevel");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Compiles every complete toplevel in [first, last) and returns the
+    // position just past the last one consumed.
+    template <typename ForwardIterator>
+    ForwardIterator
+    parser_impl(ForwardIterator first, ForwardIterator last)
+    {
+        const auto m = prog.mark();
+        const auto env_size = pending_env_size();
+
+        // rejected code must not be left behind for a later run()
+        ecci::status st;
+        auto itr = prog.append(first, last, st);
+        if (!st.ok()) { fail(st); }
+        if (!st.ok() || !verify(m.ntop, env_size))
+        {
+            prog.rollback(m);
+            return last;
+        }
+        return itr;
+    }
+
+    ecci::ecci_base &
+    splice(const program &p)
+    {
+        for (std::size_t i = 0; i != p.toplevel.size(); ++i)
+        {
+            if (!p.check(p.toplevel[i], pending_env_size() + i))
+            {
+                return fail(ecci::errc::broken_program, "broken compiled program");
+            }
+            if (reaches_retired(p, p.toplevel[i], pending_env_size() + i))
+            {
+                return fail(ecci::errc::syntax_error, "reference to a retired toplevel");
+            }
+        }
+
+        buf.clear();
+        prog.splice(p);
+        return *this;
+    }
+
+    // [first, last) starts at a toplevel and ends just after a separator.
+    // Does nothing and returns false unless it splits into two chunks or
+    // more; a single chunk is cheaper on the sequential path.
+    bool
+    parse_parallel(const char *first, const char *last);
 
 public:
     explicit
     interpreter(bool force_out = false)
+      : input(*this), output(*this, force_out)
     {
-        init(force_out);
+        init();
     }
 
     explicit
     interpreter(std::istream &in, std::ostream &out, bool force_out = false)
-      : ecci::ecci_base(in, out)
+      : ecci::ecci_base(in, out), input(*this), output(*this, force_out)
     {
-        init(force_out);
+        init();
     }
 
     explicit
@@ -493,34 +1154,164 @@ public:
 
     ~interpreter() noexcept override { release(); }
 
+    using ecci::ecci_base::parse;
+    using ecci::ecci_base::reset;
+
+    // Promises that code parsed or loaded from now on refers at most n
+    // toplevels back, not counting the primitives, so that run() can retire
+    // older slots of the global environment and free the values only they
+    // kept alive, along with the code that ran.  Later references to a
+    // retired slot fail as syntax errors, and save() fails once code has
+    // been dropped.
+    void
+    bound_reach(std::size_t n) noexcept { reach = n; }
+
+    ecci::ecci_base &
+    reset() override
+    {
+        prog.clear();
+        executed  = 0;
+        discarded = 0;
+        reach     = unbounded;
+        buf.clear();
+        clear();
+        instrument().clear();
+        profile(nullptr);
+        pool.prof = nullptr;
+        init();
+        return *this;
+    }
+
     ecci::ecci_base &
-    parse(const std::string &code) override
+    parse(const char *first, const char *last) override
     {
+        auto phase = instrument().phase("parse");
+        if (!good()) { return *this; }
 
-        std::copy_if(code.begin(), code.end(), std::back_inserter(buf), [](char c)
+        if (!buf.empty())
         {
-            return c == 'w' || c == 'W' || c == 'v';
-        });
-        parser_impl();
+            // Complete the pending toplevel through the next separator so
+            // that the rest of the range can be parsed in place.
+            auto sep = std::find(first, last, 'v');
+            if (sep != last) { ++sep; }
+            std::copy_if(first, sep, std::back_inserter(buf), is_grass_char);
+            first = sep;
+
+            buf.erase(buf.begin(), parser_impl(buf.begin(), buf.end()));
+            if (!good() || !buf.empty() || first == last) { return *this; }
+        }
+
+        if (std::size_t(last - first) >= 2 * parallel_chunk)
+        {
+            auto sep = std::find(std::reverse_iterator<const char *>(last),
+                                 std::reverse_iterator<const char *>(first), 'v').base();
+            if (parse_parallel(first, sep))
+            {
+                if (!good()) { return *this; }
+                first = sep;
+            }
+        }
+
+        auto ffirst = boost::make_filter_iterator(is_grass_char, first, last);
+        auto flast  = boost::make_filter_iterator(is_grass_char, last, last);
+        std::copy(parser_impl(ffirst, flast), flast, std::back_inserter(buf));
         return *this;
     }
 
+    ecci::ecci_base &
+    compile() override
+    {
+        if (!good() || buf.empty()) { return *this; }
+
+        auto phase = instrument().phase("parse");
+        buf += 'v';
+        parser_impl(buf.begin(), buf.end());
+        buf.clear();
+        return *this;
+    }
+
+    void
+    save(std::ostream &os) const override
+    {
+        // once run() dropped code, what is left is not a whole program
+        if (discarded) { os.setstate(std::ios::failbit); }
+        else           { prog.save(os); }
+    }
+
+    ecci::ecci_base &
+    load(std::istream &is) override
+    {
+        auto phase = instrument().phase("load");
+        if (!good()) { return *this; }
+
+        program p;
+        if (!p.load(is))
+        {
+            return fail(ecci::errc::broken_program, "broken compiled program");
+        }
+        return splice(p);
+    }
+
+    // Appends an already compiled program, such as an embedded one (see
+    // grass/embed.hpp), after the toplevels compiled so far.
+    ecci::ecci_base &
+    load(const program &p)
+    {
+        auto phase = instrument().phase("load");
+        if (!good()) { return *this; }
+        return splice(p);
+    }
+
     ecci::ecci_base &
     run() override
     {
-        if (buf.size() != 0)
+        compile();
+
+        auto phase = instrument().phase("run");
+        if (!good()) { return *this; }
+
+        pool.code = prog.pairs.data();
+        pool.prof = profile();
+
+        const bool bounded = reach != unbounded;
+        const std::size_t n = prog.toplevel.size() - executed;
+        if (bounded) { compute_floors(); }
+        for (std::size_t k = 1; executed != prog.toplevel.size(); ++k)
         {
-            buf += 'v';
-            parser_impl();
+            if (!execute(prog.toplevel[executed])) { return fail(pool.error()); }
+            ++executed;
+            if (!bounded) { continue; }
+
+            // without retirement nearly everything is live and collecting
+            // only costs time
+            if (k % retire_interval == 0 || k == n) { env.retire(floors[(k - 1) / retire_interval]); }
+            if (pool.crowded() || stale()) { collect(); }
         }
-        env.push((*env.top())(env.top()));
+
+        auto ret = (*env.top())(env.top(), pool);
+        if (!ret) { return fail(pool.error()); }
+        env.push(ret);
         return *this;
     }
 
 private:
+    _lambda::primitive::in  input;
+    _lambda::primitive::out output;
+
     environment env;
     _lambda::lambda_pool pool;
 
+    program     prog;
+    std::size_t executed = 0;
+
+    // Toplevels that ran and were dropped from prog by collect().
+    std::size_t discarded = 0;
+
+    static constexpr std::size_t unbounded = std::size_t(-1);
+
+    std::size_t              reach = unbounded;
+    std::vector<std::size_t> floors;
+
     std::string buf;
 };
 
@@ -531,17 +1322,19 @@ inline std::pair<std::size_t, ForwardIterator>
 continuos_region(ForwardIterator itr, ForwardIterator last)
 {
     std::size_t cnt = 0;
+    if (itr == last) { return std::make_pair(cnt, itr); }
     for (auto &val = *itr; itr != last && val == *itr; ++itr, ++cnt) ;
     return std::make_pair(cnt, itr);
 }
 
 } // namespace grass::<anonymous-namespace>
 
-void
-interpreter::parser_impl()
+template <typename ForwardIterator>
+ForwardIterator
+program::append(ForwardIterator first, ForwardIterator last, ecci::status &st)
 {
-    auto itr          = buf.begin();
-    auto cend         = buf.end();
+    auto itr          = first;
+    auto cend         = last;
     auto continue_itr = itr;
 
     enum
@@ -552,7 +1345,8 @@ interpreter::parser_impl()
     } state = GR_TOPLEVEL;
 
     std::size_t args = 0, func = 0;
-    _lambda::user::body_t body;
+    const std::size_t npairs = pairs.size(), ntop = toplevel.size();
+    auto body_first = npairs;
 
     // TODO: refactor this block
     while (itr != cend)
@@ -564,11 +1358,13 @@ interpreter::parser_impl()
             switch (state)
             {
               case GR_APPLICATION:
-                BOOST_THROW_EXCEPTION(
-                    grass_error("internal error (unexpected application terminate)"));
+                st = ecci::status(ecci::errc::syntax_error, "internal error (unexpected application terminate)");
+                return cend;
 
               case GR_FUNCTION:
-                inserter(new _lambda::user(pool, args, std::move(body)));
+                toplevel.push_back({ static_cast<unsigned int>(args),
+                                     body_first, pairs.size(), 0, 0 });
+                lower(toplevel.back());
                 state = GR_TOPLEVEL;
               // PATH THROUGH
 
@@ -587,6 +1383,7 @@ interpreter::parser_impl()
                   case 'w':
                     state = GR_FUNCTION;
                     args  = region.first;
+                    body_first = pairs.size();
                     break;
 
                   case 'W':
@@ -599,10 +1396,14 @@ interpreter::parser_impl()
               case GR_APPLICATION:
                 if (c != 'w')
                 {
-                    BOOST_THROW_EXCEPTION(
-                        grass_error("internal error (unexpected char in application)"));
+                    st = ecci::status(ecci::errc::syntax_error, "internal error (unexpected char in application)");
+                    return cend;
                 }
-                env.push((*env[func])(env[region.first]));
+                // the argument may continue in the next chunk
+                if (region.second == cend) { break; }
+
+                pairs.emplace_back(func - 1, region.first - 1);
+                toplevel.push_back({ 0, pairs.size() - 1, pairs.size(), 0, 0 });
                 state = GR_TOPLEVEL;
                 continue_itr = region.second;
                 break;
@@ -610,8 +1411,8 @@ interpreter::parser_impl()
               case GR_FUNCTION:
                 if (c != 'W')
                 {
-                    BOOST_THROW_EXCEPTION(
-                        grass_error("internal error (unexpected char in define function)"));
+                    st = ecci::status(ecci::errc::syntax_error, "internal error (unexpected char in define function)");
+                    return cend;
                 }
                 func = region.first;
 
@@ -620,17 +1421,132 @@ interpreter::parser_impl()
 
                 if (*itr != 'w')
                 {
-                    BOOST_THROW_EXCEPTION(
-                        grass_error("internal error (unexpected char in function args)"));
+                    st = ecci::status(ecci::errc::syntax_error, "internal error (unexpected char in function args)");
+                    return cend;
                 }
-                body.push_back(decltype(body)::value_type(func - 1, region.first - 1));
+                pairs.emplace_back(func - 1, region.first - 1);
                 break;
             }
         }
         itr = region.second;
     }
 
-    buf.assign(continue_itr, cend);
+    // drop the pairs of an unfinished function, it is parsed again later
+    pairs.resize(toplevel.size() == ntop ? npairs : toplevel.back().last);
+    return continue_itr;
+}
+
+inline bool
+interpreter::parse_parallel(const char *first, const char *last)
+{
+    const std::size_t size = last - first;
+    std::size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, size / parallel_chunk);
+    if (nthreads < 2) { return false; }
+
+    // cut just after a separator so that every chunk starts at a toplevel
+    std::vector<const char *> cuts{ first };
+    for (std::size_t i = 1; i < nthreads; ++i)
+    {
+        auto cut = std::find(std::max(cuts.back(), first + size / nthreads * i), last, 'v');
+        if (cut == last) { break; }
+        cuts.push_back(cut + 1);
+    }
+    cuts.push_back(last);
+
+    const std::size_t nchunks = cuts.size() - 1;
+    if (nchunks < 2) { return false; }
+
+    std::vector<program>      parts(nchunks);
+    std::vector<ecci::status> errors(nchunks);
+    auto work = [&](std::size_t i)
+    {
+        auto ffirst = boost::make_filter_iterator(is_grass_char, cuts[i], cuts[i + 1]);
+        auto flast  = boost::make_filter_iterator(is_grass_char, cuts[i + 1], cuts[i + 1]);
+        parts[i].append(ffirst, flast, errors[i]);
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(nchunks - 1);
+    for (std::size_t i = 1; i < nchunks; ++i) { workers.emplace_back(work, i); }
+    work(0);
+    for (auto &t : workers) { t.join(); }
+
+    const auto m = prog.mark();
+    for (std::size_t i = 0; i != nchunks; ++i)
+    {
+        if (!errors[i].ok())
+        {
+            fail(errors[i]);
+            break;
+        }
+
+        const auto ntop = prog.toplevel.size(), env_size = pending_env_size();
+        prog.splice(parts[i]);
+        if (!verify(ntop, env_size)) { break; }
+    }
+    if (!good()) { prog.rollback(m); }
+    return true;
+}
+
+inline void
+program::save(std::ostream &os) const
+{
+    using ecci::detail::put_word;
+    put_word(os, version);
+    put_word(os, toplevel.size());
+    for (auto &top : toplevel)
+    {
+        put_word(os, top.arg_num);
+        put_word(os, top.last - top.first);
+        for (auto i = top.first; i != top.last; ++i)
+        {
+            put_word(os, pairs[i].first);
+            put_word(os, pairs[i].second);
+        }
+        put_word(os, top.clast - top.cfirst);
+        for (auto i = top.cfirst; i != top.clast; ++i)
+        {
+            put_word(os, captures[i]);
+        }
+    }
+}
+
+inline bool
+program::load(std::istream &is)
+{
+    using ecci::detail::get_word;
+    std::uint32_t ver, ntop;
+    if (!get_word(is, ver) || ver != version || !get_word(is, ntop)) { return false; }
+
+    // ntop is untrusted; grow only as the toplevels are actually read
+    clear();
+    while (ntop--)
+    {
+        std::uint32_t arg_num, npairs;
+        if (!get_word(is, arg_num) || !get_word(is, npairs)) { return false; }
+
+        const auto first = pairs.size();
+        while (npairs--)
+        {
+            std::uint32_t func, arg;
+            if (!get_word(is, func) || !get_word(is, arg)) { return false; }
+            pairs.emplace_back(func, arg);
+        }
+
+        std::uint32_t ncaptures;
+        if (!get_word(is, ncaptures)) { return false; }
+
+        const auto cfirst = captures.size();
+        while (ncaptures--)
+        {
+            std::uint32_t outer;
+            if (!get_word(is, outer)) { return false; }
+            captures.push_back(outer);
+        }
+        toplevel.push_back({ arg_num, first, pairs.size(), cfirst, captures.size() });
+    }
+    return true;
 }
 
 } // namespace grass
@@ -1,18 +1,22 @@
 #include <iostream>
-#include <boost/timer/timer.hpp>
 
 #include "hq9+.hpp"
 
 int main() try
 {
-    boost::timer::auto_cpu_timer t(std::cerr, 3);
+    hq9p::interpreter interp;
+    interp.instrument().enable();
 
-    hq9p::interpreter()
+    interp
       .parse("HHQ+HQ++")
       .run();
-    t.stop();
 
     std::cerr << '\n';
+    if (!interp.good())
+    {
+        BOOST_THROW_EXCEPTION(hq9p::hq9p_error(interp.error().message()));
+    }
+    interp.instrument().report(std::cerr);
 }
 catch (hq9p::hq9p_error &e)
 {
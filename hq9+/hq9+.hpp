@@ -23,6 +23,7 @@
 #define esolang_HQ9p_hpp_
 
 #include <string>
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -37,7 +38,7 @@ struct hq9p_error : public ecci::ecci_error
 {
     explicit
     hq9p_error(const std::string &x)
-      : ecci::ecci_base("HQ9+", x)
+      : ecci::ecci_error("HQ9+", x)
     {}
 };
 
@@ -47,34 +48,35 @@ struct base
 {
     virtual ~base() noexcept { }
 
-    virtual void
+    virtual ecci::status
     operator()(ecci::ecci_base &) const = 0;
 };
 
 struct H final : public base
 {
-    void
+    ecci::status
     operator()(ecci::ecci_base &i) const override
     {
         i.out() << "Hello, world!";
+        return ecci::status();
     }
 };
 
 struct Q final : public base
 {
-    void
+    ecci::status
     operator()(ecci::ecci_base &) const override
     {
-        BOOST_THROW_EXCEPTION(hq9p_error("todo: implement hq9p::insn::Q"));
+        return ecci::status(ecci::errc::not_implemented, "todo: implement hq9p::insn::Q");
     }
 };
 
 struct nine final : public base
 {
-    void
+    ecci::status
     operator()(ecci::ecci_base &) const override
     {
-        BOOST_THROW_EXCEPTION(hq9p_error("todo: implement hq9p::insn::nine"));
+        return ecci::status(ecci::errc::not_implemented, "todo: implement hq9p::insn::nine");
     }
 };
 
@@ -84,10 +86,10 @@ struct plus final : public base
     constexpr
     plus() noexcept : acc() {}
 
-    void
+    ecci::status
     operator()(ecci::ecci_base &) const override
     {
-        BOOST_THROW_EXCEPTION(hq9p_error("todo: implement hq9p::insn::plus"));
+        return ecci::status(ecci::errc::not_implemented, "todo: implement hq9p::insn::plus");
     }
 
 private:
@@ -106,7 +108,13 @@ private:
 
 public:
     interpreter()
-      : pool {
+      : interpreter(std::cin, std::cout)
+    { }
+
+    explicit
+    interpreter(std::istream &in, std::ostream &out)
+      : ecci::ecci_base(in, out),
+        pool {
           {"H", h},
           {"Q", q},
           {"9", n},
@@ -114,23 +122,104 @@ public:
         }
     { }
 
+    explicit
+    interpreter(std::iostream &inout)
+      : interpreter(inout, inout)
+    { }
+
+    using ecci::ecci_base::parse;
+    using ecci::ecci_base::reset;
+
+    ecci::ecci_base &
+    reset() override
+    {
+        body.clear();
+        clear();
+        instrument().clear();
+        profile(nullptr);
+        return *this;
+    }
+
+    ecci::ecci_base &
+    parse(const char *first, const char *last) override
+    {
+        auto phase = instrument().phase("parse");
+        if (!good()) { return *this; }
+
+        std::string key(1, '\0');
+        for (; first != last; ++first)
+        {
+            key[0] = *first;
+            auto itr = pool.find(key);
+            if (itr != pool.end()) { body.push_back(itr); }
+        }
+        return *this;
+    }
+
+    ecci::ecci_base &
+    compile() override
+    {
+        return *this;
+    }
+
+    void
+    save(std::ostream &os) const override
+    {
+        using ecci::detail::put_word;
+        put_word(os, version);
+        put_word(os, body.size());
+        for (auto &c : body)
+        {
+            os.put(c->first[0]);
+        }
+    }
+
     ecci::ecci_base &
-    parse(const std::string &code) override
+    load(std::istream &is) override
     {
+        auto phase = instrument().phase("load");
+        if (!good()) { return *this; }
+
+        using ecci::detail::get_word;
+        std::uint32_t ver, n;
+        if (!get_word(is, ver) || ver != version || !get_word(is, n))
+        {
+            return fail(ecci::errc::broken_program, "broken compiled program");
+        }
+
+        decltype(body) loaded;
+        std::string key(1, '\0');
+        while (n--)
+        {
+            auto itr = is.get(key[0]) ? pool.find(key) : pool.end();
+            if (itr == pool.end())
+            {
+                return fail(ecci::errc::broken_program, "broken compiled program");
+            }
+            loaded.push_back(itr);
+        }
+        body.insert(body.end(), loaded.begin(), loaded.end());
         return *this;
     }
 
     ecci::ecci_base &
     run() override
     {
+        auto phase = instrument().phase("run");
+        if (!good()) { return *this; }
+
         for (auto &c : body)
         {
-            c->second(*this);
+            auto st = c->second.get()(*this);
+            if (!st.ok()) { return fail(st); }
         }
         return *this;
     }
 
 private:
+    // bumped whenever the serialized layout changes
+    static constexpr std::uint32_t version = 1;
+
     template <typename T>
     using ref = std::reference_wrapper<T>;
 
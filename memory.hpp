@@ -19,8 +19,15 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#ifndef esolang_memory_hpp_
+#define esolang_memory_hpp_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace ecci {
 
@@ -31,5 +38,101 @@ make_unique_ptr(A &&... a)
     return std::unique_ptr<T>(new T(std::forward<A>(a)...));
 }
 
+// Monotonic allocator.  Memory is handed out from large chunks and only
+// given back as a whole; release() rewinds to the first chunk but keeps
+// every chunk for the next round.  Destruction of the objects is up to
+// the owner.
+class arena
+{
+    struct chunk
+    {
+        char        *data;
+        std::size_t  size;
+    };
+
+    std::vector<chunk> chunks;
+    std::size_t        current = 0;
+    char              *ptr     = nullptr;
+    char              *end     = nullptr;
+    std::size_t        chunk_size;
+
+    void
+    use(std::size_t idx) noexcept
+    {
+        current = idx;
+        ptr     = chunks[idx].data;
+        end     = ptr + chunks[idx].size;
+    }
+
+    void *
+    grow(std::size_t n, std::size_t align)
+    {
+        const std::size_t need = n + align;
+        std::size_t next = chunks.empty() ? 0 : current + 1;
+        if (next == chunks.size() || chunks[next].size < need)
+        {
+            const std::size_t size = need < chunk_size ? chunk_size : need;
+            chunks.reserve(chunks.size() + 1);
+            chunks.insert(chunks.begin() + next,
+                          chunk{ static_cast<char *>(::operator new(size)), size });
+        }
+        use(next);
+        return allocate(n, align);
+    }
+
+public:
+    arena(const arena &) = delete;
+    arena &
+    operator=(const arena &) = delete;
+
+    explicit
+    arena(std::size_t chunk_size = 64 << 10) noexcept
+      : chunk_size(chunk_size)
+    {}
+
+    ~arena() noexcept
+    {
+        for (auto &c : chunks) { ::operator delete(c.data); }
+    }
+
+    void *
+    allocate(std::size_t n, std::size_t align = alignof(std::max_align_t))
+    {
+        const std::size_t pad = -reinterpret_cast<std::uintptr_t>(ptr) & (align - 1);
+        if (ptr == nullptr || std::size_t(end - ptr) < n + pad) { return grow(n, align); }
+
+        void *p = ptr + pad;
+        ptr += pad + n;
+        return p;
+    }
+
+    void
+    release() noexcept
+    {
+        if (chunks.empty()) { return; }
+        use(0);
+    }
+
+    // Calls f(first, last) on every chunk, in use or not.
+    template <typename F>
+    void
+    for_each_chunk(F f) const
+    {
+        for (auto &c : chunks) { f(static_cast<const char *>(c.data), c.data + c.size); }
+    }
+
+    void
+    swap(arena &a) noexcept
+    {
+        chunks.swap(a.chunks);
+        std::swap(current, a.current);
+        std::swap(ptr, a.ptr);
+        std::swap(end, a.end);
+        std::swap(chunk_size, a.chunk_size);
+    }
+};
+
 } // namespace ecci
 
+#endif // esolang_memory_hpp_
+
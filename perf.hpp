@@ -0,0 +1,397 @@
+// Esolang compiler collections interpreter - perf.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_perf_hpp_
+#define esolang_perf_hpp_
+
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+
+#include <boost/optional.hpp>
+#include <boost/timer/timer.hpp>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace ecci {
+
+// Hardware counters of the calling thread, opened as one group so that
+// the kernel schedules them onto the PMU together and their counts cover
+// the same stretch of time.  A counter that cannot join the group stays
+// unavailable.  When other events compete for the PMU the group only runs
+// part of the time it is enabled; read() returns both times so that counts
+// can be scaled.
+class perf_counters
+{
+public:
+    enum counter
+    {
+      CYCLES = 0,
+      INSTRUCTIONS,
+      CACHE_MISSES,
+      BRANCH_MISSES,
+
+      _SIZE
+    };
+
+    struct values
+    {
+        bool          valid[_SIZE];
+        std::uint64_t count[_SIZE];
+        std::uint64_t enabled, running;
+    };
+
+private:
+    int fds[_SIZE];
+    int leader = -1;
+
+#ifdef __linux__
+    static int
+    open_counter(std::uint64_t config, int group) noexcept
+    {
+        ::perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP
+                            | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return ::syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+    }
+#endif
+
+public:
+    perf_counters(const perf_counters &) = delete;
+    perf_counters &
+    operator=(const perf_counters &) = delete;
+
+    perf_counters() noexcept
+    {
+        std::fill(fds, fds + _SIZE, -1);
+#ifdef __linux__
+        static const std::uint64_t configs[_SIZE] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        // the first counter that opens leads the group
+        for (int i = 0; i != _SIZE; ++i)
+        {
+            fds[i] = open_counter(configs[i], leader);
+            if (leader < 0) { leader = fds[i]; }
+        }
+#endif
+    }
+
+    ~perf_counters() noexcept
+    {
+#ifdef __linux__
+        for (int fd : fds)
+        {
+            if (fd >= 0) { ::close(fd); }
+        }
+#endif
+    }
+
+    bool
+    available() const noexcept { return leader >= 0; }
+
+    values
+    read() const noexcept
+    {
+        values v;
+        std::fill(v.valid, v.valid + _SIZE, false);
+        std::fill(v.count, v.count + _SIZE, 0);
+        v.enabled = v.running = 0;
+#ifdef __linux__
+        if (leader < 0) { return v; }
+
+        // nr, time enabled, time running, then the counts in opening order
+        std::uint64_t buf[3 + _SIZE];
+        const auto n = ::read(leader, buf, sizeof(buf));
+        const auto nr = std::count_if(fds, fds + _SIZE, [](int fd) { return fd >= 0; });
+        if (n != std::int64_t((3 + nr) * sizeof(buf[0])) || buf[0] != std::uint64_t(nr)) { return v; }
+
+        v.enabled = buf[1];
+        v.running = buf[2];
+        for (int i = 0, k = 3; i != _SIZE; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                v.valid[i] = true;
+                v.count[i] = buf[k++];
+            }
+        }
+#endif
+        return v;
+    }
+};
+
+// CPU time of the calling thread in nanoseconds: the exact total and the
+// part the kernel accounted to system time.  False where threads are not
+// accounted separately.
+struct thread_cpu_times
+{
+    std::int64_t total, system;
+};
+
+inline bool
+thread_cpu_time(thread_cpu_times &t) noexcept
+{
+#if defined(__linux__) && defined(RUSAGE_THREAD)
+    ::timespec ts;
+    ::rusage   ru;
+    if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0 && ::getrusage(RUSAGE_THREAD, &ru) == 0)
+    {
+        t.total  = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        t.system = (ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec) * 1000;
+        return true;
+    }
+#endif
+    (void)t;
+    return false;
+}
+
+// Phase-scoped measurements.  Disabled by default, in which case a phase
+// costs one branch.  Phases of the same name accumulate, and nested phases
+// are measured independently of their enclosing phase.  Counters and CPU
+// time are those of the thread that runs the phase, so an interpreter may
+// be measured on any thread, one at a time.
+class instrumentation
+{
+public:
+    struct phase_stats
+    {
+        std::string               name;
+        unsigned int              calls;
+        boost::timer::cpu_times   times;
+        perf_counters::values     counters;
+        // some counts were scaled up from a share of the time
+        bool                      multiplexed;
+    };
+
+    class scope
+    {
+        instrumentation                          *owner;
+        const char                               *name;
+        boost::optional<boost::timer::cpu_timer>  timer;
+        const perf_counters                      *pmu;
+        perf_counters::values                     start;
+        thread_cpu_times                          cpu;
+        bool                                      per_thread;
+
+    public:
+        scope(const scope &) = delete;
+        scope &
+        operator=(const scope &) = delete;
+
+        scope(scope &&s) noexcept
+          : owner(s.owner), name(s.name), timer(s.timer), pmu(s.pmu), start(s.start),
+            cpu(s.cpu), per_thread(s.per_thread)
+        {
+            s.owner = nullptr;
+        }
+
+        scope(instrumentation &i, const char *n)
+          : owner(i.enabled() ? &i : nullptr), name(n), timer(), pmu(nullptr), start(),
+            cpu(), per_thread(false)
+        {
+            if (!owner) { return; }
+            if ((pmu = owner->thread_counters())) { start = pmu->read(); }
+            timer = boost::timer::cpu_timer();
+            per_thread = thread_cpu_time(cpu);
+        }
+
+        ~scope() noexcept
+        {
+            if (!owner) { return; }
+            thread_cpu_times now{};
+            per_thread = per_thread && thread_cpu_time(now);
+            timer->stop();
+            const auto end = pmu ? pmu->read() : start;
+            auto t = timer->elapsed();
+
+            // cpu_timer measures the whole process
+            if (per_thread)
+            {
+                const auto total = now.total - cpu.total;
+                t.system = std::max<std::int64_t>(0, std::min(total, now.system - cpu.system));
+                t.user   = total - t.system;
+            }
+            try
+            {
+                owner->record(name, t, start, end);
+            }
+            catch (...) {}
+        }
+    };
+
+private:
+    std::unique_ptr<perf_counters> pmu;
+    std::thread::id                pmu_thread;
+    std::vector<phase_stats>       phases;
+    bool                           on = false, counting = false;
+
+    // A counter only counts the thread that opened it, so the counters
+    // are reopened whenever a phase starts on another thread.
+    const perf_counters *
+    thread_counters() noexcept
+    {
+        if (!counting) { return nullptr; }
+        if (pmu_thread != std::this_thread::get_id())
+        {
+            pmu_thread = std::this_thread::get_id();
+            pmu.reset(new (std::nothrow) perf_counters());
+            if (pmu && !pmu->available()) { pmu.reset(); }
+        }
+        return pmu.get();
+    }
+
+    void
+    record(const char *name, const boost::timer::cpu_times &t,
+           const perf_counters::values &start, const perf_counters::values &end)
+    {
+        auto itr = std::find_if(phases.begin(), phases.end(), [&](const phase_stats &p)
+        {
+            return p.name == name;
+        });
+        if (itr == phases.end())
+        {
+            phase_stats p;
+            p.name  = name;
+            p.calls = 0;
+            p.multiplexed = false;
+            p.times.clear();
+            for (int i = 0; i != perf_counters::_SIZE; ++i)
+            {
+                p.counters.valid[i] = start.valid[i];
+                p.counters.count[i] = 0;
+            }
+            itr = phases.insert(phases.end(), std::move(p));
+        }
+
+        ++itr->calls;
+        itr->times.wall   += t.wall;
+        itr->times.user   += t.user;
+        itr->times.system += t.system;
+        // A group that shared the PMU counted only while running; scale its
+        // counts to the whole phase, and give up on them if it never ran.
+        const auto enabled = end.enabled - start.enabled, running = end.running - start.running;
+        const bool scaled = running < enabled;
+        itr->multiplexed = itr->multiplexed || (scaled && running != 0);
+        for (int i = 0; i != perf_counters::_SIZE; ++i)
+        {
+            itr->counters.valid[i] = itr->counters.valid[i] && end.valid[i] && !(scaled && running == 0);
+            const auto delta = end.count[i] - start.count[i];
+            itr->counters.count[i] += scaled && running != 0
+              ? std::uint64_t(double(delta) * enabled / running + 0.5)
+              : delta;
+        }
+    }
+
+public:
+    bool
+    enabled() const noexcept { return on; }
+
+    // Opens the hardware counters when use_counters is set and the system
+    // permits; wall and CPU time are recorded either way.
+    void
+    enable(bool use_counters = true)
+    {
+        on = true;
+        if (use_counters && !counting)
+        {
+            // probe on the calling thread; other threads open their own
+            pmu_thread = std::this_thread::get_id();
+            pmu.reset(new perf_counters());
+            counting = pmu->available();
+            if (!counting) { pmu.reset(); }
+        }
+    }
+
+    void
+    disable() noexcept { on = false; }
+
+    bool
+    has_counters() const noexcept { return counting; }
+
+    scope
+    phase(const char *name) { return scope(*this, name); }
+
+    const std::vector<phase_stats> &
+    results() const noexcept { return phases; }
+
+    void
+    clear() noexcept { phases.clear(); }
+
+    void
+    report(std::ostream &os, bool verbose = true) const
+    {
+        static const char *const names[] = {
+            "cycles", "instructions", "cache-misses", "branch-misses"
+        };
+        const char *fmt = verbose
+          ? "%ws wall, %us user + %ss system = %ts CPU (%p%)"
+          : "%ws wall";
+
+        for (auto &p : phases)
+        {
+            os << p.name << ": " << boost::timer::format(p.times, 6, fmt);
+            if (verbose)
+            {
+                bool any = false;
+                for (int i = 0; i != perf_counters::_SIZE; ++i)
+                {
+                    if (p.counters.valid[i])
+                    {
+                        os << ", " << p.counters.count[i] << ' ' << names[i];
+                        any = true;
+                    }
+                }
+                if (any && p.multiplexed) { os << " (multiplexed, scaled)"; }
+            }
+            os << '\n';
+        }
+        if (verbose && !counting)
+        {
+            os << "(hardware counters unavailable)\n";
+        }
+    }
+};
+
+} // namespace ecci
+
+#endif // esolang_perf_hpp_
@@ -0,0 +1,376 @@
+// Esolang compiler collections interpreter - pipeline.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_pipeline_hpp_
+#define esolang_pipeline_hpp_
+
+#include <istream>
+#include <ostream>
+#include <streambuf>
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ecci.hpp"
+#include "memory.hpp"
+
+namespace ecci {
+
+namespace detail {
+
+// Spins briefly, then yields, then sleeps for up to a millisecond.
+class backoff
+{
+    unsigned int n = 0;
+
+public:
+    void
+    operator()()
+    {
+        if (n < 64) { ++n; }
+        else if (n < 128)
+        {
+            ++n;
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min(1000u, n)));
+            n += n < 1000 ? 64 : 0;
+        }
+    }
+};
+
+} // namespace ecci::detail
+
+// Bounded single-producer single-consumer byte queue.  Both sides work in
+// place on contiguous spans of the ring, so bytes are written once by the
+// producer and read once by the consumer with no copy in between.  Either
+// side may close; the other one then sees the end of the stream or a
+// failed write.
+class spsc_ring
+{
+    // Keeps the indices of the two sides on separate cache lines.
+    struct index
+    {
+        std::atomic<std::size_t> pos;
+        std::atomic<bool>        closed;
+        char                     pad[64 - sizeof(std::atomic<std::size_t>) - sizeof(std::atomic<bool>)];
+    };
+
+    std::unique_ptr<char[]> buf;
+    std::size_t             mask;
+    char                    pad[64];
+    index                   head, tail;
+
+    static std::size_t
+    round_up(std::size_t n) noexcept
+    {
+        std::size_t c = 64;
+        while (c < n) { c <<= 1; }
+        return c;
+    }
+
+public:
+    spsc_ring(const spsc_ring &) = delete;
+    spsc_ring &
+    operator=(const spsc_ring &) = delete;
+
+    // The capacity is rounded up to a power of two.
+    explicit
+    spsc_ring(std::size_t capacity = std::size_t(1) << 16)
+      : buf(new char[round_up(capacity)]), mask(round_up(capacity) - 1)
+    {
+        head.pos = tail.pos = 0;
+        head.closed = tail.closed = false;
+    }
+
+    std::size_t
+    capacity() const noexcept { return mask + 1; }
+
+    // Producer side: the free span after the committed bytes, empty when
+    // the ring is full.
+    std::pair<char *, std::size_t>
+    writable() noexcept
+    {
+        const auto h = head.pos.load(std::memory_order_relaxed);
+        const auto n = capacity() - (h - tail.pos.load(std::memory_order_acquire));
+        return { buf.get() + (h & mask), std::min(n, capacity() - (h & mask)) };
+    }
+
+    // Hands the first n bytes of the writable span to the consumer.
+    void
+    commit(std::size_t n) noexcept
+    {
+        head.pos.store(head.pos.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    void
+    close_write() noexcept { head.closed.store(true, std::memory_order_release); }
+
+    bool
+    read_closed() const noexcept { return tail.closed.load(std::memory_order_acquire); }
+
+    // Consumer side: the committed span, empty when the ring is empty.
+    std::pair<const char *, std::size_t>
+    readable() noexcept
+    {
+        const auto t = tail.pos.load(std::memory_order_relaxed);
+        const auto n = head.pos.load(std::memory_order_acquire) - t;
+        return { buf.get() + (t & mask), std::min(n, capacity() - (t & mask)) };
+    }
+
+    // Gives the first n bytes of the readable span back to the producer.
+    void
+    consume(std::size_t n) noexcept
+    {
+        tail.pos.store(tail.pos.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    void
+    close_read() noexcept { tail.closed.store(true, std::memory_order_release); }
+
+    bool
+    write_closed() const noexcept { return head.closed.load(std::memory_order_acquire); }
+};
+
+// Producer end of a ring.  The put area lies in the ring itself and is
+// committed a batch at a time, on overflow and on flush.  Writes fail once
+// the consumer has closed its end.
+class ring_outbuf : public std::streambuf
+{
+    spsc_ring   &ring;
+    std::size_t  batch;
+
+    void
+    publish() noexcept
+    {
+        ring.commit(pptr() - pbase());
+        setp(pptr(), pptr());
+    }
+
+protected:
+    int_type
+    overflow(int_type c) override
+    {
+        publish();
+        std::pair<char *, std::size_t> span;
+        for (detail::backoff wait; ; wait())
+        {
+            if (ring.read_closed()) { return traits_type::eof(); }
+            if ((span = ring.writable()).second) { break; }
+        }
+
+        setp(span.first, span.first + std::min(span.second, batch));
+        if (traits_type::eq_int_type(c, traits_type::eof())) { return traits_type::not_eof(c); }
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+    int
+    sync() override
+    {
+        publish();
+        return 0;
+    }
+
+public:
+    explicit
+    ring_outbuf(spsc_ring &r, std::size_t batch = 4096) noexcept
+      : ring(r), batch(std::max<std::size_t>(1, std::min(batch, r.capacity())))
+    {}
+
+    ~ring_outbuf() noexcept { close(); }
+
+    // Commits what is left and signals the end of the stream.
+    void
+    close() noexcept
+    {
+        publish();
+        ring.close_write();
+    }
+};
+
+// Consumer end of a ring.  The get area lies in the ring itself and is
+// given back to the producer a batch at a time, on underflow.
+class ring_inbuf : public std::streambuf
+{
+    spsc_ring &ring;
+
+    void
+    release() noexcept
+    {
+        ring.consume(gptr() - eback());
+        setg(gptr(), gptr(), gptr());
+    }
+
+protected:
+    int_type
+    underflow() override
+    {
+        release();
+        std::pair<const char *, std::size_t> span;
+        for (detail::backoff wait; !(span = ring.readable()).second; wait())
+        {
+            // the last commit happens before the close
+            if (ring.write_closed())
+            {
+                if (!(span = ring.readable()).second) { return traits_type::eof(); }
+                break;
+            }
+        }
+
+        char *p = const_cast<char *>(span.first);
+        setg(p, p, p + span.second);
+        return traits_type::to_int_type(*p);
+    }
+
+public:
+    explicit
+    ring_inbuf(spsc_ring &r) noexcept
+      : ring(r)
+    {}
+
+    ~ring_inbuf() noexcept { close(); }
+
+    // Gives up on the rest of the stream, so that the producer stops
+    // waiting for room.
+    void
+    close() noexcept
+    {
+        release();
+        ring.close_read();
+    }
+};
+
+// Runs interpreters as the stages of a pipeline, each on its own thread,
+// with the output of a stage fed to the input of the next through an
+// spsc_ring.  Stages are not owned and must be ready to run; their streams
+// are rebound for the run and restored afterwards.
+class pipeline
+{
+    struct link
+    {
+        spsc_ring    ring;
+        ring_outbuf  outbuf;
+        ring_inbuf   inbuf;
+        std::ostream os;
+        std::istream is;
+
+        link(std::size_t capacity, std::size_t batch)
+          : ring(capacity), outbuf(ring, batch), inbuf(ring), os(&outbuf), is(&inbuf)
+        {}
+    };
+
+    std::vector<ecci_base *> stages;
+    std::size_t              capacity, batch;
+
+public:
+    pipeline(const pipeline &) = delete;
+    pipeline &
+    operator=(const pipeline &) = delete;
+
+    // Each link buffers up to capacity bytes and hands them over batch
+    // bytes at a time.
+    explicit
+    pipeline(std::size_t capacity = std::size_t(1) << 16, std::size_t batch = 4096) noexcept
+      : capacity(capacity), batch(batch)
+    {}
+
+    pipeline &
+    add(ecci_base &stage)
+    {
+        stages.push_back(&stage);
+        return *this;
+    }
+
+    std::size_t
+    size() const noexcept { return stages.size(); }
+
+    // Runs every stage to completion, the first one reading in and the last
+    // one writing out.  Returns whether every stage stayed good; exceptions
+    // thrown by a stage are rethrown here once all of them have finished.
+    bool
+    run(std::istream &in, std::ostream &out)
+    {
+        const std::size_t n = stages.size();
+        if (n == 0) { return true; }
+
+        std::vector<std::unique_ptr<link>> links;
+        for (std::size_t i = 1; i != n; ++i) { links.push_back(make_unique_ptr<link>(capacity, batch)); }
+
+        std::vector<std::pair<std::istream *, std::ostream *>> saved;
+        for (auto s : stages) { saved.emplace_back(&s->in(), &s->out()); }
+
+        std::vector<std::exception_ptr> errors(n);
+        auto body = [&](std::size_t i)
+        {
+            try
+            {
+                stages[i]->rebind(i ? links[i - 1]->is : in, i + 1 != n ? links[i]->os : out);
+                stages[i]->run();
+                stages[i]->out().flush();
+            }
+            catch (...) { errors[i] = std::current_exception(); }
+
+            if (i)         { links[i - 1]->inbuf.close(); }
+            if (i + 1 < n) { links[i]->outbuf.close(); }
+        };
+
+        std::vector<std::thread> threads;
+        std::exception_ptr spawn;
+        try
+        {
+            for (std::size_t i = 0; i + 1 < n; ++i) { threads.emplace_back(body, i); }
+        }
+        catch (...) { spawn = std::current_exception(); }
+
+        // without the rest of the stages, the running ones write nowhere
+        if (!spawn) { body(n - 1); }
+        else if (!threads.empty()) { links[threads.size() - 1]->inbuf.close(); }
+        for (auto &t : threads) { t.join(); }
+
+        bool ok = true;
+        for (std::size_t i = 0; i != n; ++i)
+        {
+            stages[i]->rebind(*saved[i].first, *saved[i].second);
+            ok = ok && stages[i]->good();
+        }
+        if (spawn) { std::rethrow_exception(spawn); }
+        for (auto &e : errors)
+        {
+            if (e) { std::rethrow_exception(e); }
+        }
+        return ok;
+    }
+};
+
+} // namespace ecci
+
+#endif // esolang_pipeline_hpp_
@@ -0,0 +1,134 @@
+// Esolang compiler collections interpreter - pool.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_pool_hpp_
+#define esolang_pool_hpp_
+
+#include <istream>
+#include <ostream>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "memory.hpp"
+
+namespace ecci {
+
+// Thread-safe pool of ready-to-run interpreters.  Interpreters are reset
+// when their handle goes away, so acquire() only rebinds the streams.  Up to
+// max_idle interpreters are kept; the rest are destroyed on return.
+template <typename Interpreter>
+class interpreter_pool
+{
+    std::mutex                                 mtx;
+    std::vector<std::unique_ptr<Interpreter>>  idle;
+    std::size_t                                max_idle;
+
+    void
+    give_back(std::unique_ptr<Interpreter> &&p) noexcept
+    {
+        try
+        {
+            p->reset();
+            std::lock_guard<std::mutex> lock(mtx);
+            if (idle.size() < max_idle) { idle.push_back(std::move(p)); }
+        }
+        catch (...) {}
+    }
+
+public:
+    class handle
+    {
+        friend class interpreter_pool;
+
+        interpreter_pool             *owner;
+        std::unique_ptr<Interpreter>  interp;
+
+        handle(interpreter_pool &o, std::unique_ptr<Interpreter> &&p) noexcept
+          : owner(&o), interp(std::move(p))
+        {}
+
+    public:
+        handle(const handle &) = delete;
+        handle &
+        operator=(const handle &) = delete;
+
+        handle(handle &&h) noexcept
+          : owner(h.owner), interp(std::move(h.interp))
+        {}
+
+        ~handle() noexcept
+        {
+            if (interp) { owner->give_back(std::move(interp)); }
+        }
+
+        Interpreter &
+        operator*() const noexcept { return *interp; }
+
+        Interpreter *
+        operator->() const noexcept { return interp.get(); }
+    };
+
+    interpreter_pool(const interpreter_pool &) = delete;
+    interpreter_pool &
+    operator=(const interpreter_pool &) = delete;
+
+    explicit
+    interpreter_pool(std::size_t max_idle = 16)
+      : max_idle(max_idle)
+    {}
+
+    // Constructs interpreters up front so the first requests are cheap too.
+    void
+    reserve(std::size_t n)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        while (idle.size() < n && idle.size() < max_idle)
+        {
+            idle.push_back(make_unique_ptr<Interpreter>());
+        }
+    }
+
+    handle
+    acquire(std::istream &in, std::ostream &out)
+    {
+        std::unique_ptr<Interpreter> p;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!idle.empty())
+            {
+                p = std::move(idle.back());
+                idle.pop_back();
+            }
+        }
+        if (!p) { p = make_unique_ptr<Interpreter>(); }
+
+        p->rebind(in, out);
+        return handle(*this, std::move(p));
+    }
+};
+
+} // namespace ecci
+
+#endif // esolang_pool_hpp_
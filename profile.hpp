@@ -0,0 +1,283 @@
+// Esolang compiler collections interpreter - profile.hpp
+//                  Copyright(c) 2010 - 2014 Flast All rights reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef esolang_profile_hpp_
+#define esolang_profile_hpp_
+
+#include <ostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/time.h>
+
+namespace ecci {
+
+// Shadow call stack of an interpreter thread, sampled from a SIGPROF
+// handler on the same thread.  The interpreter pushes and pops frame ids,
+// the handler copies the stack into a single-producer ring, and collect()
+// drains the ring from any thread into folded-stack counts.
+class stack_profile
+{
+public:
+    static constexpr std::size_t max_depth = 64;
+    static constexpr std::size_t capacity  = 1024;
+
+private:
+    struct sample
+    {
+        std::uint32_t depth;
+        std::uint32_t frames[max_depth];
+    };
+
+    std::uint32_t            frames[max_depth];
+    std::atomic<std::size_t> depth;
+
+    std::unique_ptr<sample[]>  ring;
+    std::atomic<std::size_t>   head, tail;
+    std::atomic<std::uint64_t> lost;
+
+    std::mutex                                           mtx;
+    std::map<std::vector<std::uint32_t>, std::uint64_t>  counts;
+
+    static std::size_t
+    recorded(std::size_t d) noexcept { return d < max_depth ? d : std::size_t(max_depth); }
+
+    static stack_profile *&
+    current() noexcept
+    {
+        static thread_local stack_profile *p = nullptr;
+        return p;
+    }
+
+    static void
+    handler(int) noexcept
+    {
+        const int saved = errno;
+        if (stack_profile *p = current()) { p->record(); }
+        errno = saved;
+    }
+
+    friend class sampler;
+
+    // Async-signal-safe; drops the sample when the ring is full.
+    void
+    record() noexcept
+    {
+        const auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == capacity)
+        {
+            lost.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto &s = ring[h % capacity];
+        s.depth = depth.load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+        std::copy(frames, frames + recorded(s.depth), s.frames);
+        head.store(h + 1, std::memory_order_release);
+    }
+
+public:
+    stack_profile(const stack_profile &) = delete;
+    stack_profile &
+    operator=(const stack_profile &) = delete;
+
+    stack_profile()
+      : depth(0), ring(new sample[capacity]), head(0), tail(0), lost(0)
+    {}
+
+    ~stack_profile() noexcept { detach(); }
+
+    // Frames deeper than max_depth are counted but not recorded.
+    void
+    push(std::uint32_t id) noexcept
+    {
+        const auto d = depth.load(std::memory_order_relaxed);
+        if (d < max_depth) { frames[d] = id; }
+        std::atomic_signal_fence(std::memory_order_release);
+        depth.store(d + 1, std::memory_order_relaxed);
+    }
+
+    void
+    pop() noexcept
+    {
+        depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+
+    // Samples taken on the calling thread go to this profile.
+    void
+    attach() noexcept { current() = this; }
+
+    void
+    detach() noexcept
+    {
+        if (current() == this) { current() = nullptr; }
+    }
+
+    // Moves the recorded samples into the counts.
+    void
+    collect()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto t = tail.load(std::memory_order_relaxed);
+        for (const auto h = head.load(std::memory_order_acquire); t != h; ++t)
+        {
+            const auto &s = ring[t % capacity];
+            std::vector<std::uint32_t> key(s.frames, s.frames + recorded(s.depth));
+            ++counts[key];
+        }
+        tail.store(t, std::memory_order_release);
+    }
+
+    std::uint64_t
+    dropped() const noexcept { return lost.load(std::memory_order_relaxed); }
+
+    // Writes "root;outer;...;inner count" lines as consumed by flame graph
+    // tools.  name(id) gives the frame names.
+    template <typename Namer>
+    void
+    report(std::ostream &os, const std::string &root, Namer name)
+    {
+        collect();
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &c : counts)
+        {
+            os << root;
+            for (auto id : c.first) { os << ';' << name(id); }
+            os << ' ' << c.second << '\n';
+        }
+    }
+
+    void
+    report(std::ostream &os, const std::string &root)
+    {
+        report(os, root, [](std::uint32_t id) { return id; });
+    }
+};
+
+// Samples the calling thread's stack_profile hz times per second of CPU
+// time through setitimer(ITIMER_PROF) while alive, and drains it from a
+// background thread.  The timer and the handler are process-wide, so only
+// one sampler may exist at a time.
+class sampler
+{
+    stack_profile           &prof;
+    struct sigaction         saved;
+    bool                     active;
+
+    std::mutex               mtx;
+    std::condition_variable  cv;
+    bool                     done;
+    std::thread              collector;
+
+    static ::itimerval
+    interval(unsigned int hz) noexcept
+    {
+        const long usec = hz ? 1000000 / hz : 0;
+        ::itimerval it;
+        it.it_interval.tv_sec  = usec / 1000000;
+        it.it_interval.tv_usec = usec % 1000000;
+        it.it_value            = it.it_interval;
+        return it;
+    }
+
+public:
+    sampler(const sampler &) = delete;
+    sampler &
+    operator=(const sampler &) = delete;
+
+    explicit
+    sampler(stack_profile &p, unsigned int hz = 997)
+      : prof(p), active(false), done(false)
+    {
+        prof.attach();
+
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &stack_profile::handler;
+        sa.sa_flags   = SA_RESTART;
+        ::sigemptyset(&sa.sa_mask);
+        if (::sigaction(SIGPROF, &sa, &saved) < 0) { return; }
+
+        const auto it = interval(std::max(1u, std::min(hz, 100000u)));
+        active = ::setitimer(ITIMER_PROF, &it, nullptr) == 0;
+        if (!active)
+        {
+            ::sigaction(SIGPROF, &saved, nullptr);
+            return;
+        }
+
+        // the ring holds about a second of samples at the default rate
+        collector = std::thread([this]
+        {
+            // leave the samples to the profiled threads
+            ::sigset_t set;
+            ::sigemptyset(&set);
+            ::sigaddset(&set, SIGPROF);
+            ::pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+            std::unique_lock<std::mutex> lock(mtx);
+            while (!cv.wait_for(lock, std::chrono::milliseconds(100), [this] { return done; }))
+            {
+                prof.collect();
+            }
+        });
+    }
+
+    ~sampler() noexcept
+    {
+        if (active)
+        {
+            const auto it = interval(0);
+            ::setitimer(ITIMER_PROF, &it, nullptr);
+            ::sigaction(SIGPROF, &saved, nullptr);
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                done = true;
+            }
+            cv.notify_one();
+            collector.join();
+        }
+        prof.detach();
+    }
+
+    // Whether the timer could be armed.
+    bool
+    running() const noexcept { return active; }
+};
+
+} // namespace ecci
+
+#endif // esolang_profile_hpp_